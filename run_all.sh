@@ -32,7 +32,7 @@ echo "Waiting for PostgreSQL to be ready..."
 sleep 5
 
 # Ensure directories exist
-mkdir -p detected_frames hls_output
+mkdir -p detected_frames hls_output clips
 
 # 3. Start Web API in background
 echo "--- Starting Web API (Background) ---"
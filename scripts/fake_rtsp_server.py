@@ -0,0 +1,407 @@
+"""Stand-in RTSP server for testing rtsp_ingest without MediaMTX or ffmpeg.
+
+Serves the H.264 or H.265 track of an MP4 file (Testing_Video.mp4 by default) on every
+path, as RTP over the RTSP TCP connection (interleaved), looping in real time. Tracks
+with B-frames are sent in decode order with presentation-time RTP timestamps, like a
+camera would. All clients of a
+server share one live timeline, so they join mid-GOP like they would with a camera.
+Standard library only.
+
+Usage: python3 scripts/fake_rtsp_server.py [--port 8554] [--video FILE]
+                                           [--stall PATH --stall-after SEC]
+                                           [--user USER --password PASS] [--log-rtcp]
+
+--stall makes the given path (e.g. /test3) stop sending video after --stall-after
+seconds while keeping the connection open, to exercise stream timeouts and reconnects.
+--user/--password require Digest authentication. --log-rtcp prints the receiver reports
+clients send back on the interleaved RTCP channel; the server sends a sender report every
+5 s so clients can fill in LSR/DLSR.
+"""
+import argparse
+import asyncio
+import base64
+import hashlib
+import os
+import random
+import struct
+import time
+
+MAX_PAYLOAD = 1400
+
+
+def read_boxes(data, start, end):
+    off = start
+    while off + 8 <= end:
+        size, kind = struct.unpack(">I4s", data[off:off + 8])
+        header = 8
+        if size == 1:
+            size = struct.unpack(">Q", data[off + 8:off + 16])[0]
+            header = 16
+        elif size == 0:
+            size = end - off
+        yield kind.decode("latin1"), off + header, off + size
+        off += size
+
+
+def find_box(data, start, end, path):
+    for kind, body, box_end in read_boxes(data, start, end):
+        if kind == path[0]:
+            if len(path) == 1:
+                return body, box_end
+            found = find_box(data, body, box_end, path[1:])
+            if found:
+                return found
+    return None
+
+
+def load_video_track(path):
+    """Returns (codec, parameter_sets, timescale, samples, duration); codec is "h264" or
+    "h265" and samples are (dts, pts, is_keyframe, [nal, ...]) in decode order."""
+    data = open(path, "rb").read()
+    moov = find_box(data, 0, len(data), ["moov"])
+    for kind, trak, trak_end in read_boxes(data, *moov):
+        if kind != "trak":
+            continue
+        stsd = find_box(data, trak, trak_end, ["mdia", "minf", "stbl", "stsd"])
+        entry_type = data[stsd[0] + 12:stsd[0] + 16] if stsd else b""
+        if entry_type not in (b"avc1", b"hvc1", b"hev1"):
+            continue
+        mdhd = find_box(data, trak, trak_end, ["mdia", "mdhd"])
+        version = data[mdhd[0]]
+        timescale = struct.unpack(">I", data[mdhd[0] + (20 if version == 1 else 12):][:4])[0]
+
+        # Visual sample entry: 8 header + 78 visual fields, then child boxes
+        entry = stsd[0] + 8
+        parameter_sets = []
+        if entry_type == b"avc1":
+            codec = "h264"
+            c = find_box(data, entry + 8 + 78, stsd[1], ["avcC"])[0]
+            nal_length_size = (data[c + 4] & 3) + 1
+            pos = c + 6
+            sps_len = struct.unpack(">H", data[pos:pos + 2])[0]
+            parameter_sets.append(data[pos + 2:pos + 2 + sps_len])
+            pos += 2 + sps_len + 1
+            pps_len = struct.unpack(">H", data[pos:pos + 2])[0]
+            parameter_sets.append(data[pos + 2:pos + 2 + pps_len])
+        else:
+            codec = "h265"
+            c = find_box(data, entry + 8 + 78, stsd[1], ["hvcC"])[0]
+            nal_length_size = (data[c + 21] & 3) + 1
+            pos = c + 23
+            for _ in range(data[c + 22]):
+                count = struct.unpack(">H", data[pos + 1:pos + 3])[0]
+                pos += 3
+                for _ in range(count):
+                    length = struct.unpack(">H", data[pos:pos + 2])[0]
+                    parameter_sets.append(data[pos + 2:pos + 2 + length])
+                    pos += 2 + length
+
+        stbl = find_box(data, trak, trak_end, ["mdia", "minf", "stbl"])
+        tables = {kind: (body, end) for kind, body, end in read_boxes(data, *stbl)}
+
+        sb = tables["stsz"][0]
+        fixed, count = struct.unpack(">II", data[sb + 4:sb + 12])
+        sizes = [fixed] * count if fixed else list(struct.unpack(">%dI" % count, data[sb + 12:sb + 12 + 4 * count]))
+
+        if "stco" in tables:
+            b = tables["stco"][0]
+            n = struct.unpack(">I", data[b + 4:b + 8])[0]
+            chunks = struct.unpack(">%dI" % n, data[b + 8:b + 8 + 4 * n])
+        else:
+            b = tables["co64"][0]
+            n = struct.unpack(">I", data[b + 4:b + 8])[0]
+            chunks = struct.unpack(">%dQ" % n, data[b + 8:b + 8 + 8 * n])
+
+        b = tables["stsc"][0]
+        n = struct.unpack(">I", data[b + 4:b + 8])[0]
+        stsc = [struct.unpack(">III", data[b + 8 + 12 * i:b + 20 + 12 * i]) for i in range(n)]
+
+        b = tables["stts"][0]
+        n = struct.unpack(">I", data[b + 4:b + 8])[0]
+        deltas = []
+        for i in range(n):
+            run, delta = struct.unpack(">II", data[b + 8 + 8 * i:b + 16 + 8 * i])
+            deltas += [delta] * run
+        # Muxers often give the last sample no duration; looping needs one
+        if len(deltas) > 1 and deltas[-1] == 0:
+            deltas[-1] = deltas[-2]
+
+        # Composition offsets (B-frames): pts = dts + offset
+        offsets_cts = []
+        if "ctts" in tables:
+            b = tables["ctts"][0]
+            n = struct.unpack(">I", data[b + 4:b + 8])[0]
+            for i in range(n):
+                run, offset = struct.unpack(">Ii", data[b + 8 + 8 * i:b + 16 + 8 * i])
+                offsets_cts += [offset] * run
+
+        keyframes = None
+        if "stss" in tables:
+            b = tables["stss"][0]
+            n = struct.unpack(">I", data[b + 4:b + 8])[0]
+            keyframes = set(struct.unpack(">%dI" % n, data[b + 8:b + 8 + 4 * n]))
+
+        # Sample offsets from the chunk table
+        offsets = []
+        sample = 0
+        for i, chunk_offset in enumerate(chunks):
+            per_chunk = 0
+            for first, samples_per_chunk, _ in stsc:
+                if first - 1 <= i:
+                    per_chunk = samples_per_chunk
+            off = chunk_offset
+            for _ in range(per_chunk):
+                if sample >= count:
+                    break
+                offsets.append(off)
+                off += sizes[sample]
+                sample += 1
+
+        samples = []
+        dts = 0
+        for i in range(count):
+            nals = []
+            pos, end = offsets[i], offsets[i] + sizes[i]
+            while pos + nal_length_size <= end:
+                length = int.from_bytes(data[pos:pos + nal_length_size], "big")
+                pos += nal_length_size
+                nals.append(data[pos:pos + length])
+                pos += length
+            key = keyframes is None or (i + 1) in keyframes
+            pts = dts + (offsets_cts[i] if i < len(offsets_cts) else 0)
+            samples.append((dts, pts, key, nals))
+            dts += deltas[i] if i < len(deltas) else deltas[-1]
+        return codec, parameter_sets, timescale, samples, dts
+    raise SystemExit("no H.264 or H.265 track in " + path)
+
+
+def rtp_packets(codec, nal, marker):
+    """Payloads for one NAL unit: a single NAL unit packet, or fragmentation units
+    (RFC 6184 FU-A for H.264, RFC 7798 FU for H.265)."""
+    if len(nal) <= MAX_PAYLOAD:
+        yield nal, marker
+        return
+    if codec == "h264":
+        header_size = 1
+        fu_header_type = nal[0] & 0x1F
+        payload_header = bytes([(nal[0] & 0xE0) | 28])
+    else:
+        header_size = 2
+        fu_header_type = (nal[0] >> 1) & 0x3F
+        payload_header = bytes([(nal[0] & 0x81) | (49 << 1), nal[1]])
+    body = nal[header_size:]
+    pos = 0
+    while pos < len(body):
+        chunk = body[pos:pos + MAX_PAYLOAD - len(payload_header) - 1]
+        start = pos == 0
+        pos += len(chunk)
+        end = pos >= len(body)
+        fu_header = (0x80 if start else 0) | (0x40 if end else 0) | fu_header_type
+        yield payload_header + bytes([fu_header]) + chunk, marker and end
+
+
+class Server:
+    def __init__(self, args):
+        self.args = args
+        self.codec, self.parameter_sets, self.timescale, self.samples, self.duration = load_video_track(args.video)
+        self.epoch = time.monotonic()
+        self.realm = "fake_rtsp_server"
+
+    def sdp(self):
+        b64 = lambda nal: base64.b64encode(nal).decode()
+        if self.codec == "h264":
+            sps, pps = self.parameter_sets[:2]
+            rtpmap = "H264/90000"
+            fmtp = "packetization-mode=1;profile-level-id=%s;sprop-parameter-sets=%s,%s" % (
+                sps[1:4].hex(), b64(sps), b64(pps))
+        else:
+            names = {32: "vps", 33: "sps", 34: "pps"}
+            rtpmap = "H265/90000"
+            fmtp = ";".join("sprop-%s=%s" % (names[(nal[0] >> 1) & 0x3F], b64(nal))
+                            for nal in self.parameter_sets if (nal[0] >> 1) & 0x3F in names)
+        return ("v=0\r\n"
+                "o=- 0 0 IN IP4 127.0.0.1\r\n"
+                "s=fake_rtsp_server\r\n"
+                "t=0 0\r\n"
+                "m=video 0 RTP/AVP 96\r\n"
+                "a=rtpmap:96 %s\r\n"
+                "a=fmtp:96 %s\r\n"
+                "a=control:trackID=0\r\n" % (rtpmap, fmtp))
+
+    def authorized(self, method, headers, nonce):
+        if not self.args.user:
+            return True
+        auth = headers.get("authorization", "")
+        if not auth.lower().startswith("digest "):
+            return False
+        params = {}
+        for part in auth[7:].split(","):
+            if "=" in part:
+                k, v = part.strip().split("=", 1)
+                params[k.lower()] = v.strip('"')
+        md5 = lambda s: hashlib.md5(s.encode()).hexdigest()
+        ha1 = md5("%s:%s:%s" % (self.args.user, self.realm, self.args.password))
+        ha2 = md5("%s:%s" % (method, params.get("uri", "")))
+        if params.get("qop") == "auth":
+            expected = md5("%s:%s:%s:%s:auth:%s" % (ha1, nonce, params.get("nc"), params.get("cnonce"), ha2))
+        else:
+            expected = md5("%s:%s:%s" % (ha1, nonce, ha2))
+        return params.get("username") == self.args.user and params.get("response") == expected
+
+    def log_rtcp(self, path, channel, data):
+        pos = 0
+        while pos + 8 <= len(data):
+            first, kind, words, sender = struct.unpack(">BBHI", data[pos:pos + 8])
+            end = pos + 4 * (words + 1)
+            if kind == 201:
+                line = "RTCP %s ch%d: RR from %08x" % (path, channel, sender)
+                for i in range(first & 0x1F):
+                    b = pos + 8 + 24 * i
+                    source, lost, ext_seq, jitter, lsr, dlsr = struct.unpack(">IIIIII", data[b:b + 24])
+                    line += (" | source %08x fraction=%d lost=%d ext_seq=%d jitter=%d lsr=%08x dlsr=%.3fs"
+                             % (source, lost >> 24, lost & 0xFFFFFF, ext_seq, jitter, lsr, dlsr / 65536))
+                print(line, flush=True)
+            elif kind == 202:
+                cname = data[pos + 10:pos + 10 + data[pos + 9]].decode("latin1")
+                print("RTCP %s ch%d: SDES cname=%s" % (path, channel, cname), flush=True)
+            pos = end
+
+    async def stream(self, writer, path):
+        stall_at = None
+        if self.args.stall and path.rstrip("/").endswith(self.args.stall.rstrip("/")):
+            stall_at = time.monotonic() + self.args.stall_after
+
+        # Join the shared live timeline at the current sample
+        elapsed = time.monotonic() - self.epoch
+        loop_ticks = self.duration
+        loops, pos = divmod(int(elapsed * self.timescale), loop_ticks)
+        index = next((i for i, s in enumerate(self.samples) if s[0] >= pos), 0)
+        seq = random.randint(0, 0xFFFF)
+        ssrc = random.randint(0, 0xFFFFFFFF)
+        ts_base = random.randint(0, 0xFFFFFFFF)
+        sent_packets = sent_bytes = 0
+        next_report = time.monotonic() + 1
+
+        while True:
+            dts, pts, _, nals = self.samples[index]
+            at = self.epoch + (loops * loop_ticks + dts) / self.timescale
+            delay = at - time.monotonic()
+            if delay > 0:
+                await asyncio.sleep(delay)
+            if stall_at and time.monotonic() >= stall_at:
+                await asyncio.sleep(3600)  # keep the connection, send nothing
+
+            rtp_ts = (ts_base + (loops * loop_ticks + pts) * 90000 // self.timescale) & 0xFFFFFFFF
+            out = bytearray()
+            for n, nal in enumerate(nals):
+                for payload, marker in rtp_packets(self.codec, nal, n == len(nals) - 1):
+                    header = struct.pack(">BBHII", 0x80, (0x80 if marker else 0) | 96, seq, rtp_ts, ssrc)
+                    seq = (seq + 1) & 0xFFFF
+                    sent_packets += 1
+                    sent_bytes += len(payload)
+                    packet = header + payload
+                    out += struct.pack(">BBH", 0x24, 0, len(packet)) + packet
+            if time.monotonic() >= next_report:
+                # Sender report: NTP wallclock, RTP time and packet/octet counts
+                now = time.time() + 2208988800
+                ntp = (int(now) << 32) | int((now % 1) * (1 << 32))
+                sr = struct.pack(">BBHIQIII", 0x80, 200, 6, ssrc, ntp, rtp_ts, sent_packets, sent_bytes)
+                out += struct.pack(">BBH", 0x24, 1, len(sr)) + sr
+                if self.args.log_rtcp:
+                    print("RTCP %s: SR ntp=%08x packets=%d" % (path, (ntp >> 16) & 0xFFFFFFFF, sent_packets), flush=True)
+                next_report = time.monotonic() + 5
+            writer.write(bytes(out))
+            await writer.drain()
+
+            index += 1
+            if index == len(self.samples):
+                index = 0
+                loops += 1
+
+    async def handle(self, reader, writer):
+        session = "%08X" % random.randint(0, 0xFFFFFFFF)
+        nonce = "%032x" % random.getrandbits(128)
+        streamer = None
+        path = "/"
+        try:
+            while True:
+                first = await reader.readexactly(1)
+                if first == b"$":
+                    # Interleaved data from the client: RTCP receiver reports
+                    channel, length = struct.unpack(">BH", await reader.readexactly(3))
+                    data = await reader.readexactly(length)
+                    if self.args.log_rtcp:
+                        self.log_rtcp(path, channel, data)
+                    continue
+                head = first + await reader.readuntil(b"\r\n\r\n")
+                lines = head.decode("latin1").split("\r\n")
+                method, url, _ = lines[0].split(" ", 2)
+                headers = {}
+                for line in lines[1:]:
+                    if ":" in line:
+                        k, v = line.split(":", 1)
+                        headers[k.strip().lower()] = v.strip()
+                if int(headers.get("content-length", 0)):
+                    await reader.readexactly(int(headers["content-length"]))
+                cseq = headers.get("cseq", "0")
+
+                if not self.authorized(method, headers, nonce):
+                    writer.write(("RTSP/1.0 401 Unauthorized\r\nCSeq: %s\r\n"
+                                  "WWW-Authenticate: Digest realm=\"%s\", nonce=\"%s\"\r\n\r\n"
+                                  % (cseq, self.realm, nonce)).encode())
+                    continue
+
+                extra, body = "", ""
+                if method == "DESCRIBE":
+                    path = "/" + url.split("/", 3)[3] if url.count("/") >= 3 else "/"
+                    body = self.sdp()
+                    extra = "Content-Base: %s/\r\nContent-Type: application/sdp\r\n" % url.rstrip("/")
+                elif method == "SETUP":
+                    extra = "Transport: RTP/AVP/TCP;unicast;interleaved=0-1\r\nSession: %s;timeout=60\r\n" % session
+                elif method == "PLAY":
+                    extra = "Session: %s\r\n" % session
+                elif method == "TEARDOWN":
+                    break
+                elif method not in ("OPTIONS", "GET_PARAMETER", "SET_PARAMETER"):
+                    writer.write(("RTSP/1.0 501 Not Implemented\r\nCSeq: %s\r\n\r\n" % cseq).encode())
+                    continue
+                if method == "OPTIONS":
+                    extra += "Public: OPTIONS, DESCRIBE, SETUP, PLAY, GET_PARAMETER, TEARDOWN\r\n"
+
+                writer.write(("RTSP/1.0 200 OK\r\nCSeq: %s\r\n%sContent-Length: %d\r\n\r\n%s"
+                              % (cseq, extra, len(body), body)).encode())
+                if method == "PLAY" and streamer is None:
+                    streamer = asyncio.ensure_future(self.stream(writer, path))
+        except (asyncio.IncompleteReadError, ConnectionError):
+            pass
+        finally:
+            if streamer:
+                streamer.cancel()
+            writer.close()
+
+
+async def main():
+    parser = argparse.ArgumentParser(description="Stand-in RTSP server (H.264/H.265 over RTP/TCP)")
+    parser.add_argument("--port", type=int, default=8554)
+    parser.add_argument("--video", default=os.path.join(os.path.dirname(__file__), "..", "Testing_Video.mp4"))
+    parser.add_argument("--stall", help="path that stops sending video, e.g. /test3")
+    parser.add_argument("--stall-after", type=float, default=10.0)
+    parser.add_argument("--user")
+    parser.add_argument("--password", default="")
+    parser.add_argument("--log-rtcp", action="store_true")
+    args = parser.parse_args()
+
+    server = Server(args)
+    keyframes = sum(1 for s in server.samples if s[2])
+    print("Serving %s (%s): %d samples, %d keyframes, %.1f s loop on rtsp://127.0.0.1:%d/<any path>"
+          % (args.video, server.codec, len(server.samples), keyframes, server.duration / server.timescale, args.port), flush=True)
+    srv = await asyncio.start_server(server.handle, "0.0.0.0", args.port)
+    async with srv:
+        await srv.serve_forever()
+
+
+if __name__ == "__main__":
+    try:
+        asyncio.run(main())
+    except KeyboardInterrupt:
+        pass
@@ -0,0 +1,55 @@
+#!/bin/bash
+# Stand-in RTSP cameras for testing rtsp_ingest: a local MediaMTX server with N paths,
+# each fed by an ffmpeg publisher looping Testing_Video.mp4 (no re-encoding).
+# With TEST_SERVER=fake (or when docker/ffmpeg are missing) scripts/fake_rtsp_server.py
+# serves the N paths instead; set FAKE_STALL=/testK to make one path stall.
+# Writes the stream list for rtsp_ingest and stops everything on Ctrl+C.
+#
+# Usage: ./scripts/start_test_streams.sh [num_streams] [stream_list]
+
+NUM_STREAMS=${1:-8}
+LIST_FILE=${2:-test_streams.txt}
+VIDEO="$(dirname "$0")/../Testing_Video.mp4"
+PORT=8554
+
+if ! command -v docker > /dev/null || ! command -v ffmpeg > /dev/null; then
+    TEST_SERVER=fake
+fi
+
+> "$LIST_FILE"
+for i in $(seq 0 $((NUM_STREAMS - 1))); do
+    echo "test$i rtsp://127.0.0.1:$PORT/test$i" >> "$LIST_FILE"
+done
+
+PIDS=()
+if [ "$TEST_SERVER" = "fake" ]; then
+    echo "--- Starting fake_rtsp_server.py on port $PORT ($NUM_STREAMS paths) ---"
+    STALL_ARGS=()
+    [ -n "$FAKE_STALL" ] && STALL_ARGS=(--stall "$FAKE_STALL" --stall-after "${FAKE_STALL_AFTER:-10}")
+    python3 "$(dirname "$0")/fake_rtsp_server.py" --port $PORT --video "$VIDEO" "${STALL_ARGS[@]}" &
+    PIDS+=($!)
+else
+    echo "--- Starting MediaMTX on port $PORT ---"
+    sudo docker rm -f ingest-test-rtsp > /dev/null 2>&1
+    sudo docker run -d --rm --name ingest-test-rtsp --network host bluenviron/mediamtx:latest > /dev/null || exit 1
+    sleep 2
+
+    echo "--- Publishing $NUM_STREAMS streams ---"
+    for i in $(seq 0 $((NUM_STREAMS - 1))); do
+        ffmpeg -hide_banner -loglevel error -re -stream_loop -1 -i "$VIDEO" -c copy \
+            -f rtsp -rtsp_transport tcp "rtsp://127.0.0.1:$PORT/test$i" &
+        PIDS+=($!)
+    done
+fi
+
+echo "Stream list written to $LIST_FILE"
+echo "Publisher PIDs: ${PIDS[*]} (kill one to exercise stream timeouts and reconnects)"
+echo "Press Ctrl+C to stop."
+
+cleanup() {
+    kill "${PIDS[@]}" 2> /dev/null
+    [ "$TEST_SERVER" = "fake" ] || sudo docker stop ingest-test-rtsp > /dev/null
+    exit 0
+}
+trap cleanup INT TERM
+wait
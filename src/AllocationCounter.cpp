@@ -0,0 +1,125 @@
+#include "AllocationCounter.hpp"
+#include <iostream>
+
+#ifdef ENABLE_ALLOC_COUNTER
+#include <cerrno>
+#include <cstddef>
+
+// glibc's own allocator. Defining malloc and friends in the executable replaces them for
+// every library in the process, libc's internal calls included.
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+}
+
+// Plain thread_locals: no constructors, so touching them from malloc cannot recurse
+static thread_local uint64_t threadAllocations = 0;
+static thread_local uint64_t threadExemptAllocations = 0;
+static thread_local int exemptDepth = 0;
+
+static inline void noteAllocation() {
+    if (exemptDepth == 0) {
+        threadAllocations++;
+    } else {
+        threadExemptAllocations++;
+    }
+}
+
+extern "C" {
+
+void* malloc(size_t size) noexcept {
+    noteAllocation();
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) noexcept {
+    noteAllocation();
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) noexcept {
+    if (size > 0) noteAllocation(); // size 0 frees
+    return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr) noexcept {
+    __libc_free(ptr);
+}
+
+void* memalign(size_t alignment, size_t size) noexcept {
+    noteAllocation();
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) noexcept {
+    noteAllocation();
+    return __libc_memalign(alignment, size);
+}
+
+// av_malloc's path on Linux
+int posix_memalign(void** out, size_t alignment, size_t size) noexcept {
+    if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0) return EINVAL;
+    noteAllocation();
+    void* p = __libc_memalign(alignment, size);
+    if (!p) return ENOMEM;
+    *out = p;
+    return 0;
+}
+
+void* valloc(size_t size) noexcept {
+    noteAllocation();
+    return __libc_memalign(4096, size);
+}
+
+} // extern "C"
+
+bool AllocationCounter::enabled() { return true; }
+uint64_t AllocationCounter::count() { return threadAllocations; }
+uint64_t AllocationCounter::exemptCount() { return threadExemptAllocations; }
+AllocationCounter::Exempt::Exempt() { exemptDepth++; }
+AllocationCounter::Exempt::~Exempt() { exemptDepth--; }
+
+#else
+
+bool AllocationCounter::enabled() { return false; }
+uint64_t AllocationCounter::count() { return 0; }
+uint64_t AllocationCounter::exemptCount() { return 0; }
+AllocationCounter::Exempt::Exempt() {}
+AllocationCounter::Exempt::~Exempt() {}
+
+#endif
+
+AllocationCounter::Loop::Loop(const char* name, uint64_t warmupIterations)
+    : name(name), warmup(warmupIterations) {}
+
+AllocationCounter::Loop::~Loop() {
+    if (!enabled() || steadyCount == 0) return;
+    std::cerr << "[ALLOC] " << name << ": " << failureCount << " of " << steadyCount
+              << " steady-state iterations allocated; exempt third-party allocations: "
+              << static_cast<double>(steadyExempt) / steadyCount << " per iteration" << std::endl;
+}
+
+void AllocationCounter::Loop::begin() {
+    mark = count();
+    exemptMark = exemptCount();
+}
+
+void AllocationCounter::Loop::end() {
+    if (!enabled()) return;
+    uint64_t allocations = count() - mark;
+    uint64_t exempt = exemptCount() - exemptMark;
+    if (++iterations <= warmup) return;
+
+    steadyCount++;
+    steadyExempt += exempt;
+    if (allocations == 0) return;
+    failureCount++;
+    if (failureCount == 1 || failureCount % 1000 == 0) {
+        std::cerr << "[ALLOC] " << name << ": iteration " << iterations << " made " << allocations
+                  << " heap allocations in steady state (expected 0); " << failureCount << " of "
+                  << steadyCount << " steady-state iterations so far" << std::endl;
+    }
+}
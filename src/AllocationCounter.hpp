@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+
+// Test hook for the zero-allocation frame path. When built with ENABLE_ALLOC_COUNTER
+// (cmake -DENABLE_ALLOC_COUNTER=ON), the malloc family is replaced and every heap
+// allocation is counted per thread: C++ new (which allocates through malloc) as well as
+// C allocations inside FFmpeg (av_malloc) and OpenCV. Otherwise count() is always 0.
+class AllocationCounter {
+public:
+    static bool enabled();
+
+    // Allocations made so far by the calling thread, outside Exempt scopes
+    static uint64_t count();
+
+    // Allocations made so far by the calling thread inside Exempt scopes
+    static uint64_t exemptCount();
+
+    // Allocations made by the calling thread inside this scope are counted in
+    // exemptCount() instead of count(). For third-party internals the pipeline cannot
+    // pool: each use says which ones, and Loop reports them rather than hiding them.
+    class Exempt {
+    public:
+        Exempt();
+        ~Exempt();
+        Exempt(const Exempt&) = delete;
+        Exempt& operator=(const Exempt&) = delete;
+    };
+
+    // Steady-state check for one loop of the calling thread: call begin() and end() around
+    // each iteration. Iterations after the warm-up must not allocate outside Exempt scopes.
+    // The first one that does is logged with an [ALLOC] message, then every 1000th; on
+    // destruction a summary gives the failures and the exempt allocations per iteration.
+    // Does nothing unless enabled().
+    class Loop {
+    public:
+        explicit Loop(const char* name, uint64_t warmupIterations = 50);
+        ~Loop();
+        Loop(const Loop&) = delete;
+        Loop& operator=(const Loop&) = delete;
+
+        void begin();
+        void end();
+
+        // Iterations after the warm-up, and how many of them allocated
+        uint64_t steadyIterations() const { return steadyCount; }
+        uint64_t failures() const { return failureCount; }
+
+    private:
+        const char* name;
+        uint64_t warmup;
+        uint64_t mark = 0;
+        uint64_t exemptMark = 0;
+        uint64_t iterations = 0;
+        uint64_t steadyCount = 0;
+        uint64_t failureCount = 0;
+        uint64_t steadyExempt = 0;
+    };
+};
@@ -0,0 +1,380 @@
+#include "ClipRecorder.hpp"
+#include "PacketQueue.hpp"
+#include <iostream>
+#include <cstdio>
+
+// Continuous detections keep extending a clip; cap it so its packets cannot pile up forever
+static const double MAX_CLIP_SEC = 60.0;
+// Finished clips waiting for the writer; further triggers are skipped until it catches up
+static const size_t MAX_PENDING_CLIPS = 2;
+
+ClipRecorder::ClipRecorder() {}
+
+ClipRecorder::~ClipRecorder() {
+    finish();
+}
+
+bool ClipRecorder::init(const std::string& outputDir, const std::string& streamName,
+                        AVCodecParameters* inputCodecParams, AVRational inputTimebase,
+                        double preRollSec, double postRollSec, size_t maxBufferedBytes,
+                        MemoryBudget& budget, MemoryBudget::Account* account) {
+    if (!inputCodecParams) {
+        std::cerr << "[CLIP] inputCodecParams is NULL!" << std::endl;
+        return false;
+    }
+
+    codecParams = avcodec_parameters_alloc();
+    if (!codecParams || avcodec_parameters_copy(codecParams, inputCodecParams) < 0) {
+        std::cerr << "[CLIP] Failed to copy codec parameters." << std::endl;
+        avcodec_parameters_free(&codecParams);
+        return false;
+    }
+
+    this->outputDir = outputDir;
+    this->streamName = streamName;
+    this->inTimebase = inputTimebase;
+    this->preRollTicks = static_cast<int64_t>(preRollSec / av_q2d(inputTimebase));
+    this->postRollTicks = static_cast<int64_t>(postRollSec / av_q2d(inputTimebase));
+    this->maxBufferedBytes = maxBufferedBytes;
+    this->budget = &budget;
+    this->account = account;
+
+    writerThread = std::thread(&ClipRecorder::writerLoop, this);
+    initialized = true;
+    std::cout << "Clip recorder initialized. Pre-roll " << preRollSec << "s, post-roll " << postRollSec
+              << "s, output: " << outputDir << std::endl;
+    return true;
+}
+
+void ClipRecorder::setThreadTopology(const ThreadTopology* topology) {
+    this->topology = topology;
+}
+
+int64_t ClipRecorder::packetTime(const AVPacket* packet) {
+    // Decode order is what the ring is kept in, so prefer dts
+    return packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+}
+
+void ClipRecorder::pushPacket(const AVPacket* packet) {
+    if (!initialized || !packet) return;
+
+    int64_t ts = packetTime(packet);
+    if (ts == AV_NOPTS_VALUE) return;
+
+    // The ring always starts on a keyframe so a clip can be decoded from its first packet
+    bool keyframe = (packet->flags & AV_PKT_FLAG_KEY) != 0;
+    if (ring.empty() && !keyframe) return;
+
+    size_t bytes = PacketQueue::packetBytes(packet);
+    bool ringCharged = reserveRing(bytes, keyframe);
+    if (ringCharged) {
+        AVPacket* ref = av_packet_clone(packet);
+        if (!ref) {
+            budget->release(account, bytes);
+            return;
+        }
+        ring.push_back(ref);
+        ringBytes += bytes;
+        lastPts = ts;
+        trimRing();
+    }
+
+    Clip* done = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (active && !ringCharged) {
+            // No room for this packet: a clip in progress ends here, a pending one waits
+            // for the ring to restart
+            if (active->endPts != AV_NOPTS_VALUE) {
+                std::cerr << "[CLIP] Memory budget exhausted, ending " << active->path << " early" << std::endl;
+                done = active.release();
+            }
+        } else if (active) {
+            if (active->endPts == AV_NOPTS_VALUE) {
+                // Newly triggered: seed with the pre-roll, which already includes this packet.
+                // The clip shares the ring's payloads, so only its packet structs are charged.
+                if (budget->tryReserve(account, ring.size() * sizeof(AVPacket))) {
+                    for (AVPacket* p : ring) {
+                        AVPacket* c = av_packet_clone(p);
+                        if (c) {
+                            active->packets.push_back(c);
+                        } else {
+                            budget->release(account, sizeof(AVPacket));
+                        }
+                    }
+                    active->endPts = lastPts + postRollTicks;
+                    extendRequested = false;
+                } else {
+                    std::cerr << "[CLIP] Memory budget exhausted, skipping " << active->path << std::endl;
+                    active.reset();
+                }
+            } else if (budget->tryReserve(account, sizeof(AVPacket))) {
+                // Shares the payload the ring just took
+                AVPacket* c = av_packet_clone(packet);
+                if (c) {
+                    active->packets.push_back(c);
+                } else {
+                    budget->release(account, sizeof(AVPacket));
+                }
+                if (extendRequested) {
+                    active->endPts = lastPts + postRollTicks;
+                    extendRequested = false;
+                }
+            } else {
+                std::cerr << "[CLIP] Memory budget exhausted, ending " << active->path << " early" << std::endl;
+                done = active.release();
+            }
+
+            if (active) {
+                int64_t clipStart = active->packets.empty() ? lastPts : packetTime(active->packets.front());
+                bool tooLong = (lastPts - clipStart) * av_q2d(inTimebase) >= MAX_CLIP_SEC;
+                if (lastPts >= active->endPts || tooLong) {
+                    done = active.release();
+                }
+            }
+        }
+    }
+    if (done) {
+        writeQueue.push(done);
+    }
+}
+
+bool ClipRecorder::reserveRing(size_t bytes, bool keyframe) {
+    // Older GOPs give way first; if even the newest one does not fit, the ring restarts
+    // at the next keyframe that does
+    while (!budget->tryReserve(account, bytes)) {
+        if (dropRingGop()) continue;
+
+        clearRing();
+        if (keyframe && budget->tryReserve(account, bytes)) break;
+        if (!ringStarved) {
+            ringStarved = true;
+            std::cerr << "[MEMORY] clip pre-roll over budget (" << budget->used() << "/" << budget->limit()
+                      << " global), restarting at the next keyframe" << std::endl;
+        }
+        return false;
+    }
+    if (ringStarved) {
+        ringStarved = false;
+        std::cerr << "[MEMORY] clip pre-roll recovered" << std::endl;
+    }
+    return true;
+}
+
+bool ClipRecorder::dropRingGop() {
+    // Drops the oldest GOP, as long as a newer one stays in the ring
+    size_t next = 1;
+    while (next < ring.size() && !(ring[next]->flags & AV_PKT_FLAG_KEY)) next++;
+    if (next >= ring.size()) return false;
+
+    size_t freed = 0;
+    for (size_t i = 0; i < next; i++) {
+        AVPacket* p = ring.front();
+        ring.pop_front();
+        ringBytes -= PacketQueue::packetBytes(p);
+        freed += releasePacket(p);
+    }
+    budget->release(account, freed);
+    return true;
+}
+
+void ClipRecorder::clearRing() {
+    size_t freed = 0;
+    for (AVPacket* p : ring) freed += releasePacket(p);
+    ring.clear();
+    ringBytes = 0;
+    if (freed > 0) budget->release(account, freed);
+}
+
+size_t ClipRecorder::releasePacket(AVPacket*& packet) {
+    // Every payload is charged once, by the ring that took it first; a clip holding the same
+    // payload only charged its packet struct. Whoever drops the last reference releases the
+    // payload. The lock keeps the ring and the writer from both seeing the other's reference.
+    size_t payload = PacketQueue::packetBytes(packet) - sizeof(AVPacket);
+    bool last;
+    {
+        std::lock_guard<std::mutex> lock(shareMtx);
+        last = !packet->buf || av_buffer_get_ref_count(packet->buf) == 1;
+        av_packet_free(&packet);
+    }
+    return sizeof(AVPacket) + (last ? payload : 0);
+}
+
+void ClipRecorder::trimRing() {
+    // Drop whole GOPs from the front while the next GOP alone still covers the pre-roll,
+    // or while over the byte cap. The newest GOP is always kept.
+    while (true) {
+        size_t next = 1;
+        while (next < ring.size() && !(ring[next]->flags & AV_PKT_FLAG_KEY)) next++;
+        if (next >= ring.size()) break;
+
+        bool nextCoversPreRoll = lastPts - packetTime(ring[next]) >= preRollTicks;
+        if (!nextCoversPreRoll && ringBytes <= maxBufferedBytes) break;
+
+        dropRingGop();
+    }
+}
+
+std::string ClipRecorder::trigger(const std::string& eventName) {
+    if (!initialized) return "";
+
+    std::lock_guard<std::mutex> lock(mtx);
+    if (active) {
+        extendRequested = true;
+        return active->path;
+    }
+    if (writeQueue.size() >= MAX_PENDING_CLIPS) {
+        if (!writerBehind) {
+            writerBehind = true;
+            std::cerr << "[CLIP] Writer is behind (" << writeQueue.size() << " clips pending), skipping clips" << std::endl;
+        }
+        return "";
+    }
+    if (writerBehind) {
+        writerBehind = false;
+        std::cerr << "[CLIP] Writer caught up, recording clips again" << std::endl;
+    }
+    active.reset(new Clip());
+    // The stream name keeps clips of cameras sharing the directory apart
+    active->path = outputDir + "/clip_" + streamName + "_" + eventName + ".mp4";
+    return active->path;
+}
+
+void ClipRecorder::finish() {
+    if (!initialized) return;
+
+    Clip* pending = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        pending = active.release();
+    }
+    if (pending) {
+        if (pending->packets.empty()) {
+            freeClip(pending);
+        } else {
+            writeQueue.push(pending);
+        }
+    }
+
+    writeQueue.stop();
+    if (writerThread.joinable()) {
+        writerThread.join();
+    }
+
+    clearRing();
+    avcodec_parameters_free(&codecParams);
+    initialized = false;
+    std::cout << "Clip recorder finished." << std::endl;
+}
+
+void ClipRecorder::writerLoop() {
+    if (topology) {
+        topology->applyToCurrentThread(PipelineStage::Mux);
+    }
+
+    Clip* clip = nullptr;
+    while (writeQueue.pop(clip)) {
+        writeClip(*clip);
+        freeClip(clip);
+    }
+}
+
+bool ClipRecorder::writeClip(Clip& clip) {
+    if (clip.packets.empty()) return false;
+
+    // Write under a temporary name so readers never see a half-written clip
+    std::string tmpPath = clip.path + ".part";
+
+    AVFormatContext* outFmtCtx = nullptr;
+    avformat_alloc_output_context2(&outFmtCtx, nullptr, "mp4", tmpPath.c_str());
+    if (!outFmtCtx) {
+        std::cerr << "[CLIP] Could not create output context for " << clip.path << std::endl;
+        return false;
+    }
+
+    AVStream* outStream = avformat_new_stream(outFmtCtx, nullptr);
+    if (!outStream || avcodec_parameters_copy(outStream->codecpar, codecParams) < 0) {
+        std::cerr << "[CLIP] Failed to set up output stream." << std::endl;
+        avformat_free_context(outFmtCtx);
+        return false;
+    }
+    outStream->codecpar->codec_tag = 0;
+    outStream->time_base = inTimebase;
+
+    if (!(outFmtCtx->oformat->flags & AVFMT_NOFILE)) {
+        if (avio_open(&outFmtCtx->pb, tmpPath.c_str(), AVIO_FLAG_WRITE) < 0) {
+            std::cerr << "[CLIP] Could not open output file '" << tmpPath << "'" << std::endl;
+            avformat_free_context(outFmtCtx);
+            return false;
+        }
+    }
+
+    AVDictionary* opts = nullptr;
+    av_dict_set(&opts, "movflags", "+faststart", 0);
+    int ret = avformat_write_header(outFmtCtx, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        std::cerr << "[CLIP] Error writing header for " << clip.path << std::endl;
+        avio_closep(&outFmtCtx->pb);
+        avformat_free_context(outFmtCtx);
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+
+    // Start the clip at zero; packets are remuxed as-is
+    int64_t offset = packetTime(clip.packets.front());
+    int64_t lastDts = AV_NOPTS_VALUE;
+    bool ok = true;
+    for (AVPacket* p : clip.packets) {
+        if (p->pts != AV_NOPTS_VALUE) p->pts -= offset;
+        if (p->dts != AV_NOPTS_VALUE) p->dts -= offset;
+        if (p->dts == AV_NOPTS_VALUE) p->dts = p->pts;
+
+        // Ensure monotonic dts
+        if (lastDts != AV_NOPTS_VALUE && p->dts <= lastDts) {
+            p->dts = lastDts + 1;
+            if (p->pts != AV_NOPTS_VALUE && p->pts < p->dts) p->pts = p->dts;
+        }
+        lastDts = p->dts;
+
+        av_packet_rescale_ts(p, inTimebase, outStream->time_base);
+        p->stream_index = outStream->index;
+        // One stream needs no interleaving; av_write_frame leaves the reference with the clip,
+        // which may share it with the ring (see releasePacket)
+        ret = av_write_frame(outFmtCtx, p);
+        if (ret < 0) {
+            std::cerr << "[CLIP] Error writing packet to " << tmpPath << " (error " << ret << ")" << std::endl;
+            ok = false;
+            break;
+        }
+    }
+
+    if (ok && (ret = av_write_trailer(outFmtCtx)) < 0) {
+        std::cerr << "[CLIP] Error writing trailer for " << tmpPath << " (error " << ret << ")" << std::endl;
+        ok = false;
+    }
+    if (!(outFmtCtx->oformat->flags & AVFMT_NOFILE) && (ret = avio_closep(&outFmtCtx->pb)) < 0) {
+        std::cerr << "[CLIP] Error closing " << tmpPath << " (error " << ret << ")" << std::endl;
+        ok = false;
+    }
+    avformat_free_context(outFmtCtx);
+
+    if (!ok) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    if (std::rename(tmpPath.c_str(), clip.path.c_str()) != 0) {
+        std::cerr << "[CLIP] Could not rename " << tmpPath << " to " << clip.path << std::endl;
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    std::cout << "[CLIP] Wrote " << clip.path << " (" << clip.packets.size() << " packets)" << std::endl;
+    return true;
+}
+
+void ClipRecorder::freeClip(Clip* clip) {
+    size_t freed = 0;
+    for (AVPacket* p : clip->packets) freed += releasePacket(p);
+    if (freed > 0) budget->release(account, freed);
+    delete clip;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "SafeQueue.hpp"
+#include "ThreadTopology.hpp"
+#include "MemoryBudget.hpp"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+}
+
+// Event clips without continuous recording: keeps the last few seconds of compressed
+// main-stream packets in memory (starting on a keyframe) and, when triggered, remuxes
+// pre-roll + post-roll into an MP4 without re-encoding.
+//
+// The ring and every clip's packets are charged to the camera's memory budget, the same
+// way as PacketQueue charges its packets. Clips share payloads with the ring by reference,
+// so a payload is charged once however many of them hold it. When the budget is exhausted the ring restarts at
+// the next keyframe and a clip in progress ends early; when the writer falls behind, new
+// triggers are skipped.
+class ClipRecorder {
+public:
+    ClipRecorder();
+    ~ClipRecorder();
+
+    // Clips are written to <outputDir>/clip_<streamName>_<event>.mp4
+    bool init(const std::string& outputDir, const std::string& streamName,
+              AVCodecParameters* inputCodecParams, AVRational inputTimebase,
+              double preRollSec, double postRollSec, size_t maxBufferedBytes,
+              MemoryBudget& budget, MemoryBudget::Account* account);
+
+    // Optional: pin the clip writer thread to the mux CPU set. Call before init().
+    void setThreadTopology(const ThreadTopology* topology);
+
+    // Mux thread: every main-stream packet, in stream order, before the HLS muxer rescales it.
+    void pushPacket(const AVPacket* packet);
+
+    // Any thread: request a clip around the current position. Returns the path the clip
+    // will appear at once complete. A trigger while a clip is recording extends its post-roll
+    // and returns that clip's path. Returns "" if the writer is too far behind to take a clip.
+    std::string trigger(const std::string& eventName);
+
+    // Writes out any clip in progress and stops the writer thread.
+    void finish();
+
+private:
+    struct Clip {
+        std::string path;
+        std::vector<AVPacket*> packets; // released with releasePacket()
+        int64_t endPts = AV_NOPTS_VALUE; // AV_NOPTS_VALUE until the mux thread starts it
+    };
+
+    std::string outputDir;
+    std::string streamName;
+    AVCodecParameters* codecParams = nullptr;
+    AVRational inTimebase{1, 90000};
+    int64_t preRollTicks = 0;
+    int64_t postRollTicks = 0;
+    size_t maxBufferedBytes = 0;
+    bool initialized = false;
+    const ThreadTopology* topology = nullptr;
+    MemoryBudget* budget = nullptr;
+    MemoryBudget::Account* account = nullptr;
+
+    // Pre-roll ring, only touched by the mux thread
+    std::deque<AVPacket*> ring;
+    size_t ringBytes = 0; // charged to the memory budget
+    int64_t lastPts = AV_NOPTS_VALUE;
+    bool ringStarved = false;
+
+    // Shared between trigger() and the mux thread
+    std::mutex mtx;
+    std::unique_ptr<Clip> active;
+    bool extendRequested = false;
+    bool writerBehind = false;
+    // Serializes dropping packet references between the mux and writer threads
+    std::mutex shareMtx;
+
+    SafeQueue<Clip*> writeQueue;
+    std::thread writerThread;
+
+    static int64_t packetTime(const AVPacket* packet);
+    bool reserveRing(size_t bytes, bool keyframe);
+    bool dropRingGop();
+    void clearRing();
+    size_t releasePacket(AVPacket*& packet);
+    void trimRing();
+    void writerLoop();
+    bool writeClip(Clip& clip);
+    void freeClip(Clip* clip);
+};
@@ -1,5 +1,6 @@
 #include "DatabaseHandler.hpp"
 #include <iostream>
+#include <cmath>
 
 DatabaseHandler::DatabaseHandler() : conn(nullptr) {}
 
@@ -27,7 +28,11 @@ bool DatabaseHandler::init(const std::string& connInfo) {
                       "class_name TEXT," \
                       "confidence REAL," \
                       "timestamp TEXT," \
-                      "frame_path TEXT);";
+                      "frame_path TEXT," \
+                      "stream_time DOUBLE PRECISION," \
+                      "clip_path TEXT);" \
+                      "ALTER TABLE detections ADD COLUMN IF NOT EXISTS stream_time DOUBLE PRECISION;" \
+                      "ALTER TABLE detections ADD COLUMN IF NOT EXISTS clip_path TEXT;";
 
     PGresult* res = PQexec(conn, sql);
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
@@ -41,31 +46,39 @@ bool DatabaseHandler::init(const std::string& connInfo) {
     return true;
 }
 
-bool DatabaseHandler::logDetection(const std::string& deviceName, const std::string& className, float confidence, const std::string& timestamp, const std::string& framePath) {
+bool DatabaseHandler::logDetection(const std::string& deviceName, const std::string& className, float confidence, const std::string& timestamp, const std::string& framePath, double streamTime, const std::string& clipPath) {
     std::cout << "[DEBUG] logDetection: this=" << this << ", conn=" << conn << std::endl;
     if (!conn) {
         std::cerr << "[ERROR] conn is NULL!" << std::endl;
         return false;
     }
 
-    const char* paramValues[5];
+    const char* paramValues[7];
     paramValues[0] = deviceName.c_str();
     paramValues[1] = className.c_str();
     std::string confStr = std::to_string(confidence);
     paramValues[2] = confStr.c_str();
     paramValues[3] = timestamp.c_str();
     paramValues[4] = framePath.c_str();
+    std::string streamTimeStr = std::to_string(streamTime);
+    paramValues[5] = std::isnan(streamTime) ? nullptr : streamTimeStr.c_str();
+    paramValues[6] = clipPath.empty() ? nullptr : clipPath.c_str();
 
+    // Insert and publish in one round-trip. Listeners (the web API) get the row on commit,
+    // so dashboards never have to poll the table.
     PGresult* res = PQexecParams(conn,
-                                 "INSERT INTO detections (device_name, class_name, confidence, timestamp, frame_path) VALUES ($1, $2, $3, $4, $5)",
-                                 5,       // nParams
+                                 "WITH ins AS ("
+                                 "INSERT INTO detections (device_name, class_name, confidence, timestamp, frame_path, stream_time, clip_path) VALUES ($1, $2, $3, $4, $5, $6, $7) "
+                                 "RETURNING id, device_name, class_name, confidence, timestamp, frame_path, stream_time, clip_path) "
+                                 "SELECT pg_notify('detections', row_to_json(ins)::text) FROM ins",
+                                 7,       // nParams
                                  nullptr, // paramTypes (let server infer)
                                  paramValues,
                                  nullptr, // paramLengths (text)
                                  nullptr, // paramFormats (text)
                                  0);      // resultFormat (text)
 
-    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         std::cerr << "Insert failed: " << PQerrorMessage(conn) << std::endl;
         PQclear(res);
         return false;
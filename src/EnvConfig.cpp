@@ -0,0 +1,37 @@
+#include "EnvConfig.hpp"
+#include <iostream>
+#include <cstdlib>
+#include <cerrno>
+
+std::string envString(const std::string& key, const std::string& defaultValue) {
+    const char* val = std::getenv(key.c_str());
+    return val ? std::string(val) : defaultValue;
+}
+
+long long envInt(const std::string& key, long long defaultValue, long long minValue) {
+    const char* val = std::getenv(key.c_str());
+    if (!val) return defaultValue;
+
+    char* end = nullptr;
+    errno = 0;
+    long long n = std::strtoll(val, &end, 10);
+    if (end == val || *end != '\0' || errno == ERANGE || n < minValue) {
+        std::cerr << "[CONFIG] Ignoring invalid " << key << "='" << val << "', using " << defaultValue << std::endl;
+        return defaultValue;
+    }
+    return n;
+}
+
+double envDouble(const std::string& key, double defaultValue, double minValue) {
+    const char* val = std::getenv(key.c_str());
+    if (!val) return defaultValue;
+
+    char* end = nullptr;
+    errno = 0;
+    double x = std::strtod(val, &end);
+    if (end == val || *end != '\0' || errno == ERANGE || !(x >= minValue)) {
+        std::cerr << "[CONFIG] Ignoring invalid " << key << "='" << val << "', using " << defaultValue << std::endl;
+        return defaultValue;
+    }
+    return x;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+#include <climits>
+
+// Env var lookups shared by the binaries. A numeric value that does not parse, or is below
+// the minimum, is logged and replaced by the default (as ThreadTopology::loadFromEnv does),
+// so a typo in the deployment never takes the process down with an exception.
+std::string envString(const std::string& key, const std::string& defaultValue);
+long long envInt(const std::string& key, long long defaultValue, long long minValue = LLONG_MIN);
+double envDouble(const std::string& key, double defaultValue, double minValue = -1e308);
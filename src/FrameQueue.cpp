@@ -0,0 +1,156 @@
+#include "FrameQueue.hpp"
+#include <iostream>
+
+extern "C" {
+#include <libavutil/imgutils.h>
+}
+
+FrameQueue::FrameQueue(const std::string& name, MemoryBudget& budget, MemoryBudget::Account* account,
+                       OverflowPolicy policy, size_t capacity)
+    : name(name), budget(budget), account(account), policy(policy) {
+    if (capacity == 0) capacity = 1;
+    ring.resize(capacity, nullptr);
+    // One per ring slot plus the one the consumer is holding
+    freeList.reserve(capacity + 1);
+    for (size_t i = 0; i < capacity + 1; i++) {
+        freeList.push_back(av_frame_alloc());
+    }
+}
+
+FrameQueue::~FrameQueue() {
+    while (count > 0) {
+        AVFrame* f = ring[head];
+        budget.release(account, frameBytes(f));
+        head = (head + 1) % ring.size();
+        count--;
+        av_frame_free(&f);
+    }
+    for (AVFrame* f : freeList) av_frame_free(&f);
+}
+
+size_t FrameQueue::frameBytes(const AVFrame* frame) {
+    // Picture data as packed by av_image_get_buffer_size, plus the frame struct. Decoder
+    // buffers carry some line padding on top, so this slightly undercounts.
+    int size = av_image_get_buffer_size(static_cast<AVPixelFormat>(frame->format), frame->width, frame->height, 1);
+    return sizeof(AVFrame) + (size > 0 ? static_cast<size_t>(size) : 0);
+}
+
+bool FrameQueue::push(AVFrame* frame) {
+    size_t bytes = frameBytes(frame);
+
+    std::unique_lock<std::mutex> lock(mtx);
+    if (stop_flag) {
+        av_frame_unref(frame);
+        return false;
+    }
+
+    bool dropped = false;
+    // The ring slot count is a hard cap whatever the policy: inference only wants the newest
+    if (count == ring.size()) {
+        dropFrontLocked();
+        dropped = true;
+    }
+
+    while (!budget.tryReserve(account, bytes)) {
+        if (!dropping) {
+            dropping = true;
+            std::cerr << "[MEMORY] " << name << " queue over budget (" << count << " frames queued, "
+                      << budget.used() << "/" << budget.limit() << " global), applying "
+                      << overflowPolicyName(policy) << std::endl;
+        }
+
+        if (policy == OverflowPolicy::Block) {
+            uint64_t gen = budget.generation();
+            lock.unlock();
+            budget.waitForRelease(gen, std::chrono::milliseconds(100));
+            lock.lock();
+            if (stop_flag) {
+                av_frame_unref(frame);
+                return false;
+            }
+            continue;
+        }
+
+        if (count == 0) {
+            // Nothing of ours left to evict: the pressure comes from elsewhere
+            droppedCount++;
+            av_frame_unref(frame);
+            return false;
+        }
+        dropFrontLocked();
+        dropped = true;
+    }
+    if (dropping) {
+        dropping = false;
+        std::cerr << "[MEMORY] " << name << " queue recovered, " << droppedCount << " frames dropped so far" << std::endl;
+    }
+
+    AVFrame* slot = nullptr;
+    if (!freeList.empty()) {
+        slot = freeList.back();
+        freeList.pop_back();
+    } else {
+        // Only if the consumer holds more than one frame at a time
+        slot = av_frame_alloc();
+        if (!slot) {
+            budget.release(account, bytes);
+            av_frame_unref(frame);
+            return false;
+        }
+    }
+
+    av_frame_move_ref(slot, frame);
+    ring[(head + count) % ring.size()] = slot;
+    count++;
+    cond.notify_one();
+    return !dropped;
+}
+
+bool FrameQueue::pop(AVFrame*& frame) {
+    std::unique_lock<std::mutex> lock(mtx);
+    cond.wait(lock, [this] { return count > 0 || stop_flag; });
+
+    if (count == 0 && stop_flag) {
+        return false;
+    }
+
+    // Stays charged until release(): the picture is still held while inference runs
+    frame = ring[head];
+    head = (head + 1) % ring.size();
+    count--;
+    return true;
+}
+
+void FrameQueue::release(AVFrame*& frame) {
+    if (!frame) return;
+    budget.release(account, frameBytes(frame));
+    av_frame_unref(frame);
+    std::lock_guard<std::mutex> lock(mtx);
+    freeList.push_back(frame);
+    frame = nullptr;
+}
+
+size_t FrameQueue::dropped() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return droppedCount;
+}
+
+void FrameQueue::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stop_flag = true;
+        cond.notify_all();
+    }
+    // Wake a decode thread blocked on the budget so it observes the stop
+    budget.wakeAll();
+}
+
+void FrameQueue::dropFrontLocked() {
+    AVFrame* oldest = ring[head];
+    head = (head + 1) % ring.size();
+    count--;
+    budget.release(account, frameBytes(oldest));
+    av_frame_unref(oldest);
+    freeList.push_back(oldest);
+    droppedCount++;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include "MemoryBudget.hpp"
+#include "PacketQueue.hpp"
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// Hand-off of decoded frames from the decode thread to the inference thread. Holds at most
+// `capacity` frames and drops the oldest when full, so inference always works on the most
+// recent picture. All AVFrame structs are allocated up front and recycled; pushing only
+// moves references to the decoder's (pooled) picture buffers.
+//
+// Each frame is charged to the camera's MemoryBudget account by its picture size from push()
+// until the consumer release()s it. Over budget, Block waits for memory and the drop
+// policies evict the oldest queued frames (every frame decodes on its own, so there is no
+// keyframe to wait for), dropping the new one if nothing is left to evict.
+class FrameQueue {
+public:
+    FrameQueue(const std::string& name, MemoryBudget& budget, MemoryBudget::Account* account,
+               OverflowPolicy policy, size_t capacity = 2);
+    ~FrameQueue();
+
+    FrameQueue(const FrameQueue&) = delete;
+    FrameQueue& operator=(const FrameQueue&) = delete;
+
+    // Moves the frame's references into the queue; `frame` is left blank for reuse.
+    // Returns false if the frame or an older one had to be dropped to make room.
+    bool push(AVFrame* frame);
+
+    // Returns true if a frame was retrieved, false if the queue is stopped and empty.
+    // Hand the frame back with release() when done.
+    bool pop(AVFrame*& frame);
+    void release(AVFrame*& frame);
+
+    size_t dropped() const;
+    void stop();
+
+    static size_t frameBytes(const AVFrame* frame);
+
+private:
+    std::string name;
+    MemoryBudget& budget;
+    MemoryBudget::Account* account;
+    OverflowPolicy policy;
+
+    std::vector<AVFrame*> ring;
+    size_t head = 0;
+    size_t count = 0;
+    std::vector<AVFrame*> freeList;
+    size_t droppedCount = 0;
+    bool dropping = false;
+    bool stop_flag = false;
+    mutable std::mutex mtx;
+    std::condition_variable cond;
+
+    void dropFrontLocked();
+};
@@ -0,0 +1,155 @@
+#include "H264Depacketizer.hpp"
+
+static const size_t MAX_ACCESS_UNIT = 8 * 1024 * 1024;
+static const uint8_t START_CODE[4] = {0, 0, 0, 1};
+// Backward steps up to this are frame reordering rather than a timestamp discontinuity
+static const int64_t MAX_REORDER_TICKS = 90000;
+
+void H264Depacketizer::push(const uint8_t* payload, size_t size, uint16_t seq, uint32_t timestamp, bool marker) {
+    if (size == 0) return;
+
+    // TCP does not lose packets, but a server may drop them when we fall behind: the
+    // access unit in progress is lost and decoding resumes at the next keyframe
+    if (haveSeq && seq != static_cast<uint16_t>(lastSeq + 1)) {
+        auCorrupt = true;
+        waitKeyframe = true;
+        fuActive = false;
+    }
+    haveSeq = true;
+    lastSeq = seq;
+
+    if (auStarted && timestamp != auTimestamp) {
+        flushAccessUnit();
+    }
+    if (!auStarted) {
+        auStarted = true;
+        auTimestamp = timestamp;
+    }
+    depacketize(payload, size);
+    if (marker) {
+        flushAccessUnit();
+    }
+}
+
+void H264Depacketizer::addParameterSet(const uint8_t* nal, size_t size) {
+    // Not part of any access unit, so the in-band flags stay untouched
+    if (size == 0) return;
+    uint8_t type = nal[0] & 0x1f;
+    if (type == 7) spsNal.assign(reinterpret_cast<const char*>(nal), size);
+    if (type == 8) ppsNal.assign(reinterpret_cast<const char*>(nal), size);
+}
+
+bool H264Depacketizer::pop(AccessUnit& unit) {
+    if (ready.empty()) return false;
+    unit = std::move(ready.front());
+    ready.pop_front();
+    return true;
+}
+
+void H264Depacketizer::reset() {
+    haveSeq = false;
+    waitKeyframe = true;
+    auStarted = false;
+    auCorrupt = false;
+    auIdr = false;
+    auHasSps = false;
+    au.clear();
+    fuActive = false;
+    haveTimestamp = false;
+    unwrappedTimestamp = 0;
+    reorderSeen = false;
+    ready.clear();
+}
+
+void H264Depacketizer::depacketize(const uint8_t* payload, size_t size) {
+    uint8_t type = payload[0] & 0x1f;
+    if (type >= 1 && type <= 23) {
+        appendNal(payload, size);
+    } else if (type == 24) {
+        // STAP-A: 16-bit size before each NAL unit
+        size_t i = 1;
+        while (i + 2 <= size) {
+            size_t len = (static_cast<size_t>(payload[i]) << 8) | payload[i + 1];
+            i += 2;
+            if (len == 0 || i + len > size) break;
+            appendNal(payload + i, len);
+            i += len;
+        }
+    } else if (type == 28) {
+        // FU-A: one NAL unit split over several packets
+        if (size < 2) return;
+        bool start = payload[1] & 0x80;
+        bool end = payload[1] & 0x40;
+        uint8_t nalHeader = (payload[0] & 0xe0) | (payload[1] & 0x1f);
+        if (start) {
+            au.insert(au.end(), START_CODE, START_CODE + 4);
+            au.push_back(nalHeader);
+            noteNal(nalHeader & 0x1f, nullptr, 0);
+            fuActive = true;
+        } else if (!fuActive) {
+            auCorrupt = true; // missed the start of this unit
+            return;
+        }
+        au.insert(au.end(), payload + 2, payload + size);
+        if (end) fuActive = false;
+    }
+    // STAP-B, MTAP and FU-B are not used by cameras in non-interleaved packetization mode
+
+    if (au.size() > MAX_ACCESS_UNIT) auCorrupt = true;
+}
+
+void H264Depacketizer::appendNal(const uint8_t* nal, size_t size) {
+    noteNal(nal[0] & 0x1f, nal, size);
+    au.insert(au.end(), START_CODE, START_CODE + 4);
+    au.insert(au.end(), nal, nal + size);
+}
+
+void H264Depacketizer::noteNal(uint8_t type, const uint8_t* nal, size_t size) {
+    if (type == 5) {
+        auIdr = true;
+    } else if (type == 7) {
+        auHasSps = true;
+        if (nal) spsNal.assign(reinterpret_cast<const char*>(nal), size);
+    } else if (type == 8) {
+        if (nal) ppsNal.assign(reinterpret_cast<const char*>(nal), size);
+    }
+}
+
+void H264Depacketizer::flushAccessUnit() {
+    bool keep = auStarted && !auCorrupt && !au.empty() && !fuActive && (auIdr || !waitKeyframe) && !reorderSeen;
+    // RTP timestamps wrap every 13 hours at 90 kHz
+    int32_t step = haveTimestamp ? static_cast<int32_t>(auTimestamp - lastTimestamp) : 0;
+    if (keep && step < 0 && step >= -MAX_REORDER_TICKS) {
+        reorderSeen = true;
+        keep = false;
+    }
+    if (keep) {
+        waitKeyframe = false;
+        haveTimestamp = true;
+        unwrappedTimestamp += step;
+        lastTimestamp = auTimestamp;
+
+        AccessUnit unit;
+        unit.pts = unwrappedTimestamp;
+        unit.keyframe = auIdr;
+        // Every keyframe carries its parameter sets, so each HLS segment decodes on its own
+        if (auIdr && !auHasSps && !spsNal.empty() && !ppsNal.empty()) {
+            unit.data.reserve(8 + spsNal.size() + ppsNal.size() + au.size());
+            unit.data.insert(unit.data.end(), START_CODE, START_CODE + 4);
+            unit.data.insert(unit.data.end(), spsNal.begin(), spsNal.end());
+            unit.data.insert(unit.data.end(), START_CODE, START_CODE + 4);
+            unit.data.insert(unit.data.end(), ppsNal.begin(), ppsNal.end());
+            unit.data.insert(unit.data.end(), au.begin(), au.end());
+        } else {
+            unit.data.swap(au);
+        }
+        ready.push_back(std::move(unit));
+    }
+
+    au.clear();
+    auStarted = false;
+    auCorrupt = false;
+    auIdr = false;
+    auHasSps = false;
+    fuActive = false;
+}
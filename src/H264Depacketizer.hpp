@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdint>
+
+// Reassembles H.264 access units from RTP payloads (RFC 6184: single NAL units, STAP-A and
+// FU-A). Output is Annex B with the RTP timestamp unwrapped to 64 bits. Data before the
+// first keyframe, and after a sequence gap up to the next keyframe, is dropped. Keyframes
+// that arrive without SPS/PPS get the last known ones prepended, so every keyframe
+// decodes on its own. Plain data in, plain data out: no sockets and no FFmpeg.
+//
+// RTP carries presentation times only, so streams with B-frames cannot be given decode
+// timestamps here. A timestamp that steps back (by up to a second) marks the stream as
+// reordered(); the offending access unit and everything after it is dropped.
+class H264Depacketizer {
+public:
+    struct AccessUnit {
+        std::vector<uint8_t> data;
+        int64_t pts = 0;
+        bool keyframe = false;
+    };
+
+    // One RTP payload (everything after the RTP header and before any padding)
+    void push(const uint8_t* payload, size_t size, uint16_t seq, uint32_t timestamp, bool marker);
+
+    // Parameter set from outside the stream, e.g. the SDP's sprop-parameter-sets
+    void addParameterSet(const uint8_t* nal, size_t size);
+
+    // Next complete access unit; false if none is buffered
+    bool pop(AccessUnit& unit);
+
+    // Forgets the stream position and anything buffered, for a new connection. The
+    // parameter sets are kept until the new stream replaces them.
+    void reset();
+
+    // True once the stream showed B-frames; cleared by reset()
+    bool reordered() const { return reorderSeen; }
+
+    const std::string& sps() const { return spsNal; }
+    const std::string& pps() const { return ppsNal; }
+
+private:
+    std::string spsNal;
+    std::string ppsNal;
+    bool haveSeq = false;
+    uint16_t lastSeq = 0;
+    bool waitKeyframe = true;
+    bool auStarted = false;
+    bool auCorrupt = false;
+    bool auIdr = false;
+    bool auHasSps = false;
+    uint32_t auTimestamp = 0;
+    std::vector<uint8_t> au;
+    bool fuActive = false;
+    bool haveTimestamp = false;
+    uint32_t lastTimestamp = 0;
+    int64_t unwrappedTimestamp = 0;
+    bool reorderSeen = false;
+    std::deque<AccessUnit> ready;
+
+    void depacketize(const uint8_t* payload, size_t size);
+    void appendNal(const uint8_t* nal, size_t size);
+    void noteNal(uint8_t type, const uint8_t* nal, size_t size);
+    void flushAccessUnit();
+};
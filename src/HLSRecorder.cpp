@@ -70,13 +70,14 @@ void HLSRecorder::writePacket(AVPacket* packet) {
     av_packet_rescale_ts(packet, inTimebase, outStream->time_base);
     packet->stream_index = outStream->index;
     
-    // Ensure monotonic Pts
-    if (lastPts != -1 && packet->pts <= lastPts) {
+    // Ensure monotonic Dts; pts may run ahead of it with B-frames
+    if (packet->dts == AV_NOPTS_VALUE) packet->dts = packet->pts;
+    if (lastDts != -1 && packet->dts <= lastDts) {
          // simple fix for non-monotonic packets
-         packet->pts = lastPts + 1;
-         packet->dts = packet->pts;
+         packet->dts = lastDts + 1;
+         if (packet->pts < packet->dts) packet->pts = packet->dts;
     }
-    lastPts = packet->pts;
+    lastDts = packet->dts;
 
     int ret = av_interleaved_write_frame(outFmtCtx, packet);
     if (ret < 0) {
@@ -23,5 +23,5 @@ private:
     AVStream* outStream = nullptr;
     AVRational inTimebase;
     bool initialized = false;
-    int64_t lastPts = -1;
+    int64_t lastDts = -1;
 };
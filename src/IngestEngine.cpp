@@ -0,0 +1,451 @@
+#include "IngestEngine.hpp"
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <chrono>
+#include <poll.h>
+
+extern "C" {
+#include <libavutil/time.h>
+}
+
+static const int64_t MIN_BACKOFF_MS = 1000;
+// Longest poll() wait, so stop() is noticed promptly even when every stream is quiet
+static const int64_t MAX_POLL_WAIT_US = 100000;
+
+// Timeline of every stream's mux input, whichever client produced it
+static const AVRational MUX_TIME_BASE = {1, 90000};
+
+IngestEngine::IngestEngine(const IngestConfig& config) : config(config) {
+    avformat_network_init(); // for the FFmpeg fallback
+}
+
+IngestEngine::~IngestEngine() {
+    stop();
+}
+
+void IngestEngine::addStream(const std::string& name, const std::string& url, const std::string& hlsOutput) {
+    std::unique_ptr<Session> s(new Session());
+    s->name = name;
+    s->url = url;
+    s->hlsOutput = hlsOutput;
+    s->stopping = &stopping;
+    s->client.reset(new RtspClient(url));
+    sessions.push_back(std::move(s));
+}
+
+void IngestEngine::setThreadTopology(const ThreadTopology* topology) {
+    this->topology = topology;
+}
+
+void IngestEngine::start() {
+    stopping = false;
+    ioThreads = static_cast<size_t>(std::max(1, config.ioThreads));
+    muxThreads = static_cast<size_t>(std::max(1, config.muxThreads));
+    std::cout << "[INGEST] Starting " << sessions.size() << " streams on " << ioThreads << " I/O threads and "
+              << muxThreads << " mux threads." << std::endl;
+
+    // All streams start due for connection. Each stream's HLS output stays on one mux thread.
+    for (size_t i = 0; i < sessions.size(); i++) {
+        sessions[i]->state = SessionState::Backoff;
+        sessions[i]->retryAt = 0;
+        sessions[i]->muxIndex = i % muxThreads;
+    }
+    muxQueues.clear();
+    for (size_t i = 0; i < muxThreads; i++) {
+        muxQueues.emplace_back(new SafeQueue<MuxItem>());
+        muxThreadPool.emplace_back(&IngestEngine::muxLoop, this, i);
+    }
+    for (size_t i = 0; i < ioThreads; i++) {
+        ioThreadPool.emplace_back(&IngestEngine::ioLoop, this, i);
+    }
+    // Streams that already moved to FFmpeg stay there across restarts
+    for (auto& s : sessions) {
+        if (s->useFfmpeg) s->ffmpegThread = std::thread(&IngestEngine::ffmpegLoop, this, s.get());
+    }
+}
+
+void IngestEngine::stop() {
+    stopping = true;
+    for (auto& t : ioThreadPool) {
+        if (t.joinable()) t.join();
+    }
+    ioThreadPool.clear();
+    for (auto& s : sessions) {
+        // Interrupted by the stopping flag
+        if (s->ffmpegThread.joinable()) s->ffmpegThread.join();
+        s->client->close();
+    }
+
+    // Mux threads write out what is still queued before they exit
+    for (auto& q : muxQueues) q->stop();
+    for (auto& t : muxThreadPool) {
+        if (t.joinable()) t.join();
+    }
+    muxThreadPool.clear();
+
+    for (auto& s : sessions) {
+        if (s->recorderReady) {
+            s->recorder.finish();
+            s->recorderReady = false;
+        }
+    }
+}
+
+void IngestEngine::ioLoop(size_t threadIndex) {
+    if (topology) {
+        topology->applyToCurrentThread(PipelineStage::Ingest);
+    }
+
+    // Streams are assigned to I/O threads round-robin and stay there across reconnects
+    std::vector<Session*> owned;
+    for (size_t i = threadIndex; i < sessions.size(); i += ioThreads) {
+        owned.push_back(sessions[i].get());
+    }
+
+    std::vector<pollfd> fds;
+    std::vector<Session*> polled;
+    fds.reserve(owned.size());
+    polled.reserve(owned.size());
+    AVPacket* packet = av_packet_alloc();
+
+    while (!stopping) {
+        // Timers first: due reconnects, connect and stream timeouts, keepalives. Then wait
+        // for socket readiness until the earliest of the next timers.
+        int64_t now = av_gettime_relative();
+        int64_t wakeAt = now + MAX_POLL_WAIT_US;
+        fds.clear();
+        polled.clear();
+        for (Session* s : owned) {
+            if (s->useFfmpeg) continue; // served by its own thread
+            if (s->state == SessionState::Backoff) {
+                if (now >= s->retryAt) startConnect(*s, now);
+            } else {
+                checkTimers(*s, now);
+            }
+            wakeAt = std::min(wakeAt, nextDeadline(*s));
+            if (s->state != SessionState::Backoff) {
+                fds.push_back({s->client->fd(), s->client->pollEvents(), 0});
+                polled.push_back(s);
+            }
+        }
+
+        int timeoutMs = wakeAt > now ? static_cast<int>((wakeAt - now + 999) / 1000) : 0;
+        int ready = poll(fds.data(), fds.size(), timeoutMs);
+        if (ready < 0) {
+            if (errno != EINTR) {
+                std::cerr << "[INGEST] poll failed: " << strerror(errno) << std::endl;
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            continue;
+        }
+        if (ready == 0) continue;
+
+        now = av_gettime_relative();
+        for (size_t i = 0; i < fds.size(); i++) {
+            if (fds[i].revents != 0) {
+                service(*polled[i], fds[i].revents, now, packet);
+            }
+        }
+    }
+    av_packet_free(&packet);
+}
+
+void IngestEngine::startConnect(Session& s, int64_t now) {
+    if (!s.client->connect(now)) {
+        scheduleReconnect(s, now, s.client->error());
+        return;
+    }
+    s.connectStartedAt = now;
+    s.state = SessionState::Connecting;
+}
+
+bool IngestEngine::service(Session& s, short revents, int64_t now, AVPacket* packet) {
+    if (!s.client->handleEvents(revents, now)) {
+        if (s.client->unsupported()) {
+            startFfmpeg(s, now);
+        } else {
+            scheduleReconnect(s, now, s.client->error());
+        }
+        return false;
+    }
+
+    if (s.state == SessionState::Connecting && s.client->playing()) {
+        startMux(s);
+        s.lastPacketAt = now;
+        s.state = SessionState::Streaming;
+        std::cout << "[INGEST] " << s.name << ": streaming" << std::endl;
+    }
+
+    while (s.client->readPacket(packet)) {
+        queuePacket(s, packet);
+        // Backoff is only reset once video flows, so a camera that accepts and then
+        // stalls keeps backing off
+        s.lastPacketAt = now;
+        s.failures = 0;
+        s.packets++;
+    }
+    return true;
+}
+
+void IngestEngine::startMux(Session& s) {
+    // Parameters of the new connection; the mux thread opens the recorder on the first one
+    MuxItem item;
+    item.session = &s;
+    item.codecPar = avcodec_parameters_alloc();
+    if (item.codecPar && avcodec_parameters_copy(item.codecPar, s.client->codecParameters()) < 0) {
+        avcodec_parameters_free(&item.codecPar);
+    }
+    item.timeBase = s.client->timeBase();
+    s.skipToKeyframe = false;
+    muxQueues[s.muxIndex]->push(item);
+}
+
+void IngestEngine::queuePacket(Session& s, AVPacket* packet) {
+    bool keyframe = packet->flags & AV_PKT_FLAG_KEY;
+    if (s.skipToKeyframe && !keyframe) {
+        av_packet_unref(packet);
+        s.dropped++;
+        return;
+    }
+
+    MuxItem item;
+    item.session = &s;
+    item.packet = packetPool.acquire();
+    av_packet_move_ref(item.packet, packet);
+    if (!muxQueues[s.muxIndex]->tryPush(item, config.muxQueuePackets)) {
+        // The mux thread is behind (slow disk): drop up to the next keyframe so the output
+        // resumes decodable instead of blocking the sockets
+        packetPool.release(item.packet);
+        s.dropped++;
+        if (!s.skipToKeyframe) {
+            std::cerr << "[INGEST] " << s.name << ": HLS output falling behind, skipping to the next keyframe" << std::endl;
+        }
+        s.skipToKeyframe = true;
+        return;
+    }
+    s.skipToKeyframe = false;
+}
+
+void IngestEngine::muxLoop(size_t threadIndex) {
+    if (topology) {
+        topology->applyToCurrentThread(PipelineStage::Mux);
+    }
+
+    SafeQueue<MuxItem>& queue = *muxQueues[threadIndex];
+    MuxItem item;
+    while (queue.pop(item)) {
+        Session& s = *item.session;
+        if (!item.packet) {
+            // The recorder outlives reconnects; later connections continue its timeline
+            if (!s.recorderReady) {
+                if (item.codecPar && s.recorder.init(s.hlsOutput, item.codecPar, item.timeBase)) {
+                    s.recorderReady = true;
+                } else {
+                    std::cerr << "[INGEST] " << s.name << ": could not start HLS output " << s.hlsOutput << std::endl;
+                    s.muxFailed = true; // the I/O thread reconnects, which retries the output
+                }
+            }
+            s.tsOffset = AV_NOPTS_VALUE;
+        } else if (s.recorderReady) {
+            remux(s, item.packet);
+        }
+        releaseItem(item);
+    }
+}
+
+void IngestEngine::releaseItem(MuxItem& item) {
+    packetPool.release(item.packet);
+    avcodec_parameters_free(&item.codecPar);
+}
+
+bool IngestEngine::checkTimers(Session& s, int64_t now) {
+    if (s.muxFailed.exchange(false)) {
+        scheduleReconnect(s, now, "HLS output failed");
+        return false;
+    }
+    if (s.state == SessionState::Connecting && now - s.connectStartedAt > config.connectTimeoutMs * 1000) {
+        scheduleReconnect(s, now, "connect timed out");
+        return false;
+    }
+    if (s.state == SessionState::Streaming && now - lastActivity(s) > config.streamTimeoutMs * 1000) {
+        scheduleReconnect(s, now, "stream timed out");
+        return false;
+    }
+    if (!s.client->tick(now)) {
+        scheduleReconnect(s, now, s.client->error());
+        return false;
+    }
+    return true;
+}
+
+int64_t IngestEngine::lastActivity(const Session& s) {
+    // Video that is still being skipped up to a keyframe also shows the camera is alive
+    return std::max(s.lastPacketAt, s.client->lastMediaUs());
+}
+
+int64_t IngestEngine::nextDeadline(const Session& s) const {
+    switch (s.state.load()) {
+    case SessionState::Backoff:
+        return s.retryAt;
+    case SessionState::Connecting:
+        return std::min(s.connectStartedAt + config.connectTimeoutMs * 1000 + 1, s.client->nextTimerUs());
+    case SessionState::Streaming:
+        return std::min(lastActivity(s) + config.streamTimeoutMs * 1000 + 1, s.client->nextTimerUs());
+    }
+    return INT64_MAX;
+}
+
+void IngestEngine::scheduleReconnect(Session& s, int64_t now, const std::string& reason) {
+    s.client->close();
+    if (stopping) return;
+
+    int64_t backoffMs = MIN_BACKOFF_MS;
+    for (int i = 0; i < s.failures && backoffMs < config.maxBackoffMs; i++) backoffMs *= 2;
+    backoffMs = std::min(backoffMs, config.maxBackoffMs);
+    s.failures++;
+    s.reconnects++;
+
+    std::cerr << "[INGEST] " << s.name << ": " << reason << ", retrying in " << backoffMs << " ms" << std::endl;
+    s.retryAt = now + backoffMs * 1000;
+    s.state = SessionState::Backoff;
+}
+
+void IngestEngine::remux(Session& s, AVPacket* packet) {
+    // The client only hands out video from a keyframe on, so segments start decodable
+    int64_t ts = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+    if (ts == AV_NOPTS_VALUE) return;
+
+    // Continue the output timeline after a reconnect instead of jumping back to zero
+    if (s.tsOffset == AV_NOPTS_VALUE) {
+        s.tsOffset = s.lastOutTs == AV_NOPTS_VALUE ? 0 : s.lastOutTs + 1 - ts;
+    }
+    if (packet->pts != AV_NOPTS_VALUE) packet->pts += s.tsOffset;
+    if (packet->dts != AV_NOPTS_VALUE) packet->dts += s.tsOffset;
+    s.lastOutTs = ts + s.tsOffset;
+
+    s.recorder.writePacket(packet);
+}
+
+void IngestEngine::startFfmpeg(Session& s, int64_t now) {
+    std::cerr << "[INGEST] " << s.name << ": " << s.client->error() << ", switching to FFmpeg's RTSP client" << std::endl;
+    s.client->close();
+    s.useFfmpeg = true;
+    s.retryAt = now;
+    s.state = SessionState::Connecting;
+    s.ffmpegThread = std::thread(&IngestEngine::ffmpegLoop, this, &s);
+}
+
+int IngestEngine::interruptCallback(void* opaque) {
+    Session* s = static_cast<Session*>(opaque);
+    if (s->stopping->load()) return 1;
+    return s->deadline != 0 && av_gettime_relative() > s->deadline;
+}
+
+void IngestEngine::ffmpegLoop(Session* s) {
+    if (topology) {
+        topology->applyToCurrentThread(PipelineStage::Ingest);
+    }
+
+    AVPacket* packet = av_packet_alloc();
+    while (!stopping) {
+        int64_t now = av_gettime_relative();
+        if (now < s->retryAt) {
+            std::this_thread::sleep_for(std::chrono::microseconds(std::min<int64_t>(s->retryAt - now, MAX_POLL_WAIT_US)));
+            continue;
+        }
+        ffmpegSession(*s, packet);
+    }
+    av_packet_free(&packet);
+}
+
+bool IngestEngine::ffmpegSession(Session& s, AVPacket* packet) {
+    s.connectStartedAt = av_gettime_relative();
+    s.state = SessionState::Connecting;
+
+    AVFormatContext* fmtCtx = avformat_alloc_context();
+    if (!fmtCtx) {
+        scheduleReconnect(s, av_gettime_relative(), "out of memory");
+        return false;
+    }
+    fmtCtx->interrupt_callback.callback = &IngestEngine::interruptCallback;
+    fmtCtx->interrupt_callback.opaque = &s;
+
+    AVDictionary* opts = nullptr;
+    av_dict_set(&opts, "rtsp_transport", "tcp", 0);
+    // One deadline covers the handshake and probing
+    s.deadline = s.connectStartedAt + config.connectTimeoutMs * 1000;
+    int ret = avformat_open_input(&fmtCtx, s.url.c_str(), nullptr, &opts);
+    av_dict_free(&opts);
+    if (ret >= 0) ret = avformat_find_stream_info(fmtCtx, nullptr);
+    s.deadline = 0;
+    int videoIndex = ret >= 0 ? av_find_best_stream(fmtCtx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0) : ret;
+    if (videoIndex < 0) {
+        avformat_close_input(&fmtCtx); // also fine after a failed open, which freed it
+        if (!stopping) scheduleReconnect(s, av_gettime_relative(), ret < 0 ? "could not open stream" : "no video stream");
+        return false;
+    }
+    AVStream* stream = fmtCtx->streams[videoIndex];
+
+    MuxItem item;
+    item.session = &s;
+    item.codecPar = avcodec_parameters_alloc();
+    if (item.codecPar && avcodec_parameters_copy(item.codecPar, stream->codecpar) < 0) {
+        avcodec_parameters_free(&item.codecPar);
+    }
+    item.timeBase = MUX_TIME_BASE;
+    s.skipToKeyframe = false;
+    muxQueues[s.muxIndex]->push(item);
+    s.lastPacketAt = av_gettime_relative();
+    s.state = SessionState::Streaming;
+    std::cout << "[INGEST] " << s.name << ": streaming (FFmpeg)" << std::endl;
+
+    std::string reason;
+    while (!stopping) {
+        if (s.muxFailed.exchange(false)) {
+            reason = "HLS output failed";
+            break;
+        }
+        // A read that gets no data for the stream timeout is interrupted
+        s.deadline = av_gettime_relative() + config.streamTimeoutMs * 1000;
+        ret = av_read_frame(fmtCtx, packet);
+        s.deadline = 0;
+        if (ret < 0) {
+            reason = ret == AVERROR_EOF ? "end of stream" : ret == AVERROR_EXIT ? "stream timed out" : "read error";
+            break;
+        }
+        if (packet->stream_index != videoIndex) {
+            av_packet_unref(packet);
+            continue;
+        }
+        av_packet_rescale_ts(packet, stream->time_base, MUX_TIME_BASE);
+        queuePacket(s, packet);
+        s.lastPacketAt = av_gettime_relative();
+        s.failures = 0;
+        s.packets++;
+    }
+    avformat_close_input(&fmtCtx);
+    if (!stopping) scheduleReconnect(s, av_gettime_relative(), reason);
+    return true;
+}
+
+void IngestEngine::logStats() const {
+    size_t streaming = 0, connecting = 0, backoff = 0, ffmpeg = 0;
+    uint64_t packets = 0, dropped = 0, reconnects = 0;
+    for (const auto& s : sessions) {
+        switch (s->state.load()) {
+        case SessionState::Streaming: streaming++; break;
+        case SessionState::Connecting: connecting++; break;
+        case SessionState::Backoff: backoff++; break;
+        }
+        if (s->useFfmpeg) ffmpeg++;
+        packets += s->packets.load();
+        dropped += s->dropped.load();
+        reconnects += s->reconnects.load();
+    }
+    std::cout << "[INGEST] streams: " << streaming << " streaming, " << connecting << " connecting, "
+              << backoff << " backing off (" << ffmpeg << " via FFmpeg) | packets: " << packets << " (" << dropped << " dropped behind HLS output)"
+              << " | reconnects: " << reconnects << std::endl;
+}
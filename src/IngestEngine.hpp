@@ -0,0 +1,133 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include "HLSRecorder.hpp"
+#include "RtspClient.hpp"
+#include "PacketPool.hpp"
+#include "SafeQueue.hpp"
+#include "ThreadTopology.hpp"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+}
+
+struct IngestConfig {
+    int ioThreads = 4;               // event loops shared by all streams
+    int muxThreads = 2;              // HLS writers shared by all streams
+    size_t muxQueuePackets = 1024;   // per mux thread; beyond this a stream skips to its next keyframe
+    int64_t connectTimeoutMs = 10000; // connect + RTSP handshake
+    int64_t streamTimeoutMs = 5000;  // no video for this long -> reconnect
+    int64_t maxBackoffMs = 30000;    // reconnect backoff doubles from 1 s up to this
+};
+
+// Remux-only ingest for many RTSP cameras. Instead of one blocking thread per camera, a
+// small fixed pool of I/O threads each runs a poll() loop over the sockets of its streams.
+// The RTSP/TCP transport is our own (RtspClient), so readiness comes from the kernel and
+// a quiet camera costs nothing until it sends data or its timeout expires. Connect and
+// stream timeouts are timers in the same loop; failed streams reconnect with backoff.
+// HLS muxing, which does file I/O, runs on a separate small pool of mux threads fed
+// through bounded queues, so a slow disk never stalls the sockets.
+//
+// Streams RtspClient cannot handle (other codecs such as H.265, or H.264 with B-frames)
+// move for good to an FFmpeg fallback: a dedicated thread with FFmpeg's RTSP demuxer,
+// which computes decode timestamps. They cost a thread each, like the ingest before the
+// poll loop, and feed the same mux threads.
+class IngestEngine {
+public:
+    explicit IngestEngine(const IngestConfig& config);
+    ~IngestEngine();
+
+    // Before start(). The stream's video is remuxed to hlsOutput.
+    void addStream(const std::string& name, const std::string& url, const std::string& hlsOutput);
+
+    // Optional: pin the I/O threads to the ingest CPU set. Must outlive start().
+    void setThreadTopology(const ThreadTopology* topology);
+
+    void start();
+    void stop();
+
+    // One line per state plus totals, for periodic monitoring
+    void logStats() const;
+
+private:
+    enum class SessionState { Backoff, Connecting, Streaming };
+
+    // The connection side is owned by one I/O thread and the HLS side by one mux thread;
+    // the atomics are shared
+    struct Session {
+        std::string name;
+        std::string url;
+        std::string hlsOutput;
+        size_t muxIndex = 0;
+
+        // I/O thread
+        std::unique_ptr<RtspClient> client;
+        int64_t connectStartedAt = 0;
+        int64_t lastPacketAt = 0;
+        int64_t retryAt = 0;
+        int failures = 0;
+        bool skipToKeyframe = false; // the mux queue was full
+
+        // FFmpeg fallback; once started, its thread owns the connection side
+        std::thread ffmpegThread;
+        int64_t deadline = 0; // for the interrupt callback, 0 = none
+        const std::atomic<bool>* stopping = nullptr;
+
+        // Mux thread
+        HLSRecorder recorder;
+        bool recorderReady = false;
+        int64_t tsOffset = AV_NOPTS_VALUE;
+        int64_t lastOutTs = AV_NOPTS_VALUE;
+
+        std::atomic<SessionState> state{SessionState::Backoff};
+        std::atomic<bool> useFfmpeg{false};
+        std::atomic<bool> muxFailed{false}; // HLS output could not be started
+        std::atomic<uint64_t> packets{0};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<uint64_t> reconnects{0};
+    };
+
+    // A packet for the session's recorder, or (packet == nullptr) the start of a new
+    // connection with its stream parameters
+    struct MuxItem {
+        Session* session = nullptr;
+        AVPacket* packet = nullptr;
+        AVCodecParameters* codecPar = nullptr;
+        AVRational timeBase{0, 1};
+    };
+
+    IngestConfig config;
+    std::vector<std::unique_ptr<Session>> sessions;
+    size_t ioThreads = 1;
+    std::vector<std::thread> ioThreadPool;
+    size_t muxThreads = 1;
+    std::vector<std::unique_ptr<SafeQueue<MuxItem>>> muxQueues;
+    std::vector<std::thread> muxThreadPool;
+    PacketPool packetPool;
+    std::atomic<bool> stopping{false};
+    const ThreadTopology* topology = nullptr;
+
+    void ioLoop(size_t threadIndex);
+    void muxLoop(size_t threadIndex);
+    void startMux(Session& s);
+    void queuePacket(Session& s, AVPacket* packet);
+    void startConnect(Session& s, int64_t now);
+    bool service(Session& s, short revents, int64_t now, AVPacket* packet);
+    bool checkTimers(Session& s, int64_t now);
+    int64_t nextDeadline(const Session& s) const;
+    static int64_t lastActivity(const Session& s);
+    void scheduleReconnect(Session& s, int64_t now, const std::string& reason);
+    void remux(Session& s, AVPacket* packet);
+    void releaseItem(MuxItem& item);
+
+    void startFfmpeg(Session& s, int64_t now);
+    void ffmpegLoop(Session* s);
+    bool ffmpegSession(Session& s, AVPacket* packet);
+    static int interruptCallback(void* opaque);
+};
@@ -0,0 +1,58 @@
+#include "MemoryBudget.hpp"
+
+MemoryBudget::MemoryBudget(size_t globalLimitBytes) : globalLimit(globalLimitBytes) {}
+
+MemoryBudget::Account* MemoryBudget::addAccount(const std::string& name, size_t limitBytes) {
+    std::lock_guard<std::mutex> lock(mtx);
+    accounts.push_back(std::make_unique<Account>());
+    Account* account = accounts.back().get();
+    account->name = name;
+    account->limit = limitBytes;
+    return account;
+}
+
+bool MemoryBudget::tryReserve(Account* account, size_t bytes) {
+    std::lock_guard<std::mutex> lock(mtx);
+    bool fitsAccount = account->used == 0 || account->used + bytes <= account->limit;
+    bool fitsGlobal = globalUsed == 0 || globalUsed + bytes <= globalLimit;
+    if (!fitsAccount || !fitsGlobal) {
+        return false;
+    }
+    account->used += bytes;
+    globalUsed += bytes;
+    if (account->used > account->peak) account->peak = account->used;
+    return true;
+}
+
+void MemoryBudget::release(Account* account, size_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        account->used -= bytes;
+        globalUsed -= bytes;
+        releaseGeneration++;
+    }
+    cond.notify_all();
+}
+
+uint64_t MemoryBudget::generation() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return releaseGeneration;
+}
+
+void MemoryBudget::waitForRelease(uint64_t seenGeneration, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mtx);
+    cond.wait_for(lock, timeout, [this, seenGeneration] { return releaseGeneration != seenGeneration; });
+}
+
+void MemoryBudget::wakeAll() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        releaseGeneration++;
+    }
+    cond.notify_all();
+}
+
+size_t MemoryBudget::used() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return globalUsed;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+
+// Pipeline-wide accountant for bytes held in inter-stage queues.
+// Every camera gets its own account; reservations must fit both the camera and the global limit.
+class MemoryBudget {
+public:
+    struct Account {
+        std::string name;
+        size_t limit = 0;
+        size_t used = 0;
+        size_t peak = 0;
+    };
+
+    explicit MemoryBudget(size_t globalLimitBytes);
+
+    // Returned pointer stays valid for the lifetime of the budget.
+    Account* addAccount(const std::string& name, size_t limitBytes);
+
+    // Reserves if it fits. An empty account/budget always accepts, so an oversized
+    // packet cannot wedge a blocking producer forever.
+    bool tryReserve(Account* account, size_t bytes);
+    void release(Account* account, size_t bytes);
+
+    // Blocking producers: take the generation before trying, then wait for it to change.
+    uint64_t generation() const;
+    void waitForRelease(uint64_t seenGeneration, std::chrono::milliseconds timeout);
+    void wakeAll();
+
+    size_t used() const;
+    size_t limit() const { return globalLimit; }
+
+private:
+    size_t globalLimit;
+    size_t globalUsed = 0;
+    uint64_t releaseGeneration = 0;
+    std::vector<std::unique_ptr<Account>> accounts;
+    mutable std::mutex mtx;
+    std::condition_variable cond;
+};
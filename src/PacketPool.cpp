@@ -0,0 +1,42 @@
+#include "PacketPool.hpp"
+
+PacketPool::PacketPool(size_t maxPooled, size_t prefill) : maxPooled(maxPooled) {
+    freeList.reserve(maxPooled);
+    for (size_t i = 0; i < prefill && i < maxPooled; i++) {
+        AVPacket* packet = av_packet_alloc();
+        if (!packet) break;
+        freeList.push_back(packet);
+        allocatedCount++;
+    }
+}
+
+PacketPool::~PacketPool() {
+    for (AVPacket* p : freeList) av_packet_free(&p);
+}
+
+AVPacket* PacketPool::acquire() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!freeList.empty()) {
+            AVPacket* packet = freeList.back();
+            freeList.pop_back();
+            return packet;
+        }
+    }
+    allocatedCount++;
+    return av_packet_alloc();
+}
+
+void PacketPool::release(AVPacket*& packet) {
+    if (!packet) return;
+    av_packet_unref(packet);
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (freeList.size() < maxPooled) {
+            freeList.push_back(packet);
+            packet = nullptr;
+            return;
+        }
+    }
+    av_packet_free(&packet);
+}
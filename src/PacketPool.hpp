@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// Recycles AVPacket structs so the steady-state packet path does not allocate them.
+// Packets are acquired on the ingest thread and released by whichever consumer finishes
+// with them, so the pool is shared and locked. It starts with `prefill` packets, so the
+// usual jitter in how many packets are in flight does not allocate once running.
+class PacketPool {
+public:
+    explicit PacketPool(size_t maxPooled = 256, size_t prefill = 64);
+    ~PacketPool();
+
+    PacketPool(const PacketPool&) = delete;
+    PacketPool& operator=(const PacketPool&) = delete;
+
+    // A blank packet, reused when one is free
+    AVPacket* acquire();
+
+    // Unreferences the packet's payload and keeps the struct for reuse (freed instead once
+    // the pool holds maxPooled). Sets packet to nullptr.
+    void release(AVPacket*& packet);
+
+    // Packets allocated so far; flat in steady state
+    size_t allocated() const { return allocatedCount; }
+
+private:
+    std::mutex mtx;
+    std::vector<AVPacket*> freeList;
+    size_t maxPooled;
+    std::atomic<size_t> allocatedCount{0};
+};
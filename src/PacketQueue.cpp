@@ -0,0 +1,200 @@
+#include "PacketQueue.hpp"
+#include <iostream>
+
+bool parseOverflowPolicy(const std::string& text, OverflowPolicy& policy) {
+    if (text == "drop-oldest") {
+        policy = OverflowPolicy::DropOldest;
+    } else if (text == "drop-non-keyframe") {
+        policy = OverflowPolicy::DropNonKeyframe;
+    } else if (text == "block") {
+        policy = OverflowPolicy::Block;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* overflowPolicyName(OverflowPolicy policy) {
+    switch (policy) {
+        case OverflowPolicy::DropOldest:      return "drop-oldest";
+        case OverflowPolicy::DropNonKeyframe: return "drop-non-keyframe";
+        case OverflowPolicy::Block:           return "block";
+    }
+    return "unknown";
+}
+
+PacketQueue::PacketQueue(const std::string& name, MemoryBudget& budget, MemoryBudget::Account* account,
+                         PacketPool& pool, OverflowPolicy policy, size_t maxPackets)
+    : name(name), budget(budget), account(account), packetPool(pool), policy(policy), maxPackets(maxPackets) {
+    ring.resize(maxPackets > 0 ? maxPackets : 64);
+}
+
+PacketQueue::~PacketQueue() {
+    clear();
+}
+
+size_t PacketQueue::packetBytes(const AVPacket* packet) {
+    // Payload plus the padding libavcodec requires and the packet struct itself.
+    // Clones share a refcounted payload, so a packet held by two queues is counted twice.
+    return sizeof(AVPacket) + static_cast<size_t>(packet->size) + AV_INPUT_BUFFER_PADDING_SIZE;
+}
+
+bool PacketQueue::push(AVPacket* packet) {
+    if (!packet) return false;
+
+    Entry entry{packet, packetBytes(packet), (packet->flags & AV_PKT_FLAG_KEY) != 0};
+
+    std::unique_lock<std::mutex> lock(mtx);
+    if (stop_flag) {
+        lock.unlock();
+        packetPool.release(packet);
+        return false;
+    }
+
+    // After a drop, non-keyframes would not decode anyway; skip to the next keyframe.
+    if (policy == OverflowPolicy::DropNonKeyframe && awaitingKeyframe && !entry.keyframe) {
+        droppedCount++;
+        lock.unlock();
+        packetPool.release(packet);
+        return false;
+    }
+
+    while (!reserveLocked(entry.bytes)) {
+        if (!dropping) {
+            dropping = true;
+            std::cerr << "[MEMORY] " << name << " queue over budget (" << queuedBytes << " bytes queued, "
+                      << budget.used() << "/" << budget.limit() << " global), applying "
+                      << overflowPolicyName(policy) << std::endl;
+        }
+
+        if (policy == OverflowPolicy::Block) {
+            uint64_t gen = budget.generation();
+            lock.unlock();
+            budget.waitForRelease(gen, std::chrono::milliseconds(100));
+            lock.lock();
+            if (stop_flag) {
+                lock.unlock();
+                packetPool.release(packet);
+                return false;
+            }
+            continue;
+        }
+
+        if (count == 0 || (policy == OverflowPolicy::DropNonKeyframe && !entry.keyframe)) {
+            // Nothing of ours left to evict (the pressure comes from elsewhere), or this
+            // is a non-keyframe: drop it and resync on the next keyframe.
+            awaitingKeyframe = true;
+            droppedCount++;
+            lock.unlock();
+            packetPool.release(packet);
+            return false;
+        }
+
+        if (policy == OverflowPolicy::DropOldest) {
+            dropFrontLocked();
+        } else {
+            dropOldestGopLocked();
+        }
+    }
+
+    if (entry.keyframe) awaitingKeyframe = false;
+    if (dropping) {
+        dropping = false;
+        std::cerr << "[MEMORY] " << name << " queue recovered, " << droppedCount << " packets dropped so far" << std::endl;
+    }
+    pushBackLocked(entry);
+    queuedBytes += entry.bytes;
+    cond.notify_one();
+    return true;
+}
+
+bool PacketQueue::pop(AVPacket*& packet) {
+    std::unique_lock<std::mutex> lock(mtx);
+    cond.wait(lock, [this] { return count > 0 || stop_flag; });
+
+    if (count == 0 && stop_flag) {
+        return false;
+    }
+
+    Entry entry = popFrontLocked();
+    queuedBytes -= entry.bytes;
+    budget.release(account, entry.bytes);
+    packet = entry.packet;
+    return true;
+}
+
+size_t PacketQueue::size() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return count;
+}
+
+size_t PacketQueue::bytes() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return queuedBytes;
+}
+
+size_t PacketQueue::dropped() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return droppedCount;
+}
+
+void PacketQueue::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stop_flag = true;
+        cond.notify_all();
+    }
+    // Wake producers blocked on the budget so they observe the stop
+    budget.wakeAll();
+}
+
+void PacketQueue::clear() {
+    std::lock_guard<std::mutex> lock(mtx);
+    while (count > 0) {
+        dropFrontLocked();
+    }
+}
+
+void PacketQueue::pushBackLocked(const Entry& entry) {
+    if (count == ring.size()) {
+        // Unroll into a larger ring; only happens while the backlog is deeper than ever before
+        std::vector<Entry> grown(ring.size() * 2);
+        for (size_t i = 0; i < count; i++) {
+            grown[i] = ring[(head + i) % ring.size()];
+        }
+        ring.swap(grown);
+        head = 0;
+    }
+    ring[(head + count) % ring.size()] = entry;
+    count++;
+}
+
+PacketQueue::Entry PacketQueue::popFrontLocked() {
+    Entry entry = ring[head];
+    head = (head + 1) % ring.size();
+    count--;
+    return entry;
+}
+
+bool PacketQueue::reserveLocked(size_t bytes) {
+    if (maxPackets > 0 && count >= maxPackets) {
+        return false;
+    }
+    return budget.tryReserve(account, bytes);
+}
+
+void PacketQueue::dropFrontLocked() {
+    Entry entry = popFrontLocked();
+    queuedBytes -= entry.bytes;
+    budget.release(account, entry.bytes);
+    packetPool.release(entry.packet);
+    droppedCount++;
+}
+
+void PacketQueue::dropOldestGopLocked() {
+    // Drop the head and everything up to the next keyframe so the consumer resumes on a decodable packet
+    dropFrontLocked();
+    while (count > 0 && !ring[head].keyframe) {
+        dropFrontLocked();
+    }
+}
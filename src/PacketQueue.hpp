@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include "MemoryBudget.hpp"
+#include "PacketPool.hpp"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// What a producer does when a push would exceed the memory budget
+enum class OverflowPolicy {
+    DropOldest,      // evict queued packets from the front until the new one fits
+    DropNonKeyframe, // drop incoming packets up to the next keyframe; keyframes evict the oldest GOP
+    Block            // wait for the consumer (or another queue) to free memory
+};
+
+bool parseOverflowPolicy(const std::string& text, OverflowPolicy& policy);
+const char* overflowPolicyName(OverflowPolicy policy);
+
+// SafeQueue for AVPacket* that charges each packet's bytes against a MemoryBudget account.
+// The queue owns queued packets: dropped packets and leftovers at destruction go back to the pool.
+class PacketQueue {
+public:
+    PacketQueue(const std::string& name, MemoryBudget& budget, MemoryBudget::Account* account,
+                PacketPool& pool, OverflowPolicy policy, size_t maxPackets = 0);
+    ~PacketQueue();
+
+    PacketQueue(const PacketQueue&) = delete;
+    PacketQueue& operator=(const PacketQueue&) = delete;
+
+    // Takes ownership. Returns false if the packet was dropped instead of queued.
+    // Packets must come from pool().
+    bool push(AVPacket* packet);
+
+    // Returns true if value was retrieved, false if queue is stopped and empty.
+    // Hand the packet back with pool().release() when done.
+    bool pop(AVPacket*& packet);
+
+    PacketPool& pool() { return packetPool; }
+
+    size_t size() const;
+    size_t bytes() const;
+    size_t dropped() const;
+
+    void stop();
+    void clear();
+
+    static size_t packetBytes(const AVPacket* packet);
+
+private:
+    struct Entry {
+        AVPacket* packet;
+        size_t bytes;
+        bool keyframe;
+    };
+
+    std::string name;
+    MemoryBudget& budget;
+    MemoryBudget::Account* account;
+    PacketPool& packetPool;
+    OverflowPolicy policy;
+    size_t maxPackets; // 0 = bounded by bytes only
+
+    // Ring buffer; grows (doubling) until it fits the deepest backlog, then never reallocates
+    std::vector<Entry> ring;
+    size_t head = 0;
+    size_t count = 0;
+    size_t queuedBytes = 0;
+    size_t droppedCount = 0;
+    bool awaitingKeyframe = false;
+    bool dropping = false;
+    mutable std::mutex mtx;
+    std::condition_variable cond;
+    bool stop_flag = false;
+
+    void pushBackLocked(const Entry& entry);
+    Entry popFrontLocked();
+    bool reserveLocked(size_t bytes);
+    void dropFrontLocked();
+    void dropOldestGopLocked();
+};
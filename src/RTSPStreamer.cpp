@@ -1,6 +1,11 @@
 #include "RTSPStreamer.hpp"
+#include "AllocationCounter.hpp"
 #include <iostream>
 
+extern "C" {
+#include <libavutil/time.h>
+}
+
 RTSPStreamer::RTSPStreamer() : shouldStop(false) {
     avformat_network_init();
 }
@@ -15,11 +20,39 @@ RTSPStreamer::~RTSPStreamer() {
 bool RTSPStreamer::open(const std::string& url) {
     std::cout << "[DEBUG-RTSP] open called with: " << url << std::endl;
     rtspUrl = url;
+
+    bool limited = probeSize > 0 || analyzeDuration > 0;
+    if (!openInput(url, limited)) {
+        return false;
+    }
+
+    // Without SPS/PPS in the SDP, the dimensions only show up with the first keyframe. If
+    // the capped probe ended before one, fall back to FFmpeg's defaults once.
+    AVCodecParameters* par = fmtCtx->streams[videoStreamIndex]->codecpar;
+    if (limited && (par->width <= 0 || par->height <= 0)) {
+        std::cerr << "[RTSP] " << url << ": no frame size after probing " << probeSize << " bytes / "
+                  << analyzeDuration / 1000 << " ms, probing again with FFmpeg defaults" << std::endl;
+        avformat_close_input(&fmtCtx);
+        if (!openInput(url, false)) {
+            return false;
+        }
+    }
+
+    clock.setTimeBase(fmtCtx->streams[videoStreamIndex]->time_base);
+
+    std::cout << "RTSP Stream opened. Video Stream Index: " << videoStreamIndex << std::endl;
+    return true;
+}
+
+bool RTSPStreamer::openInput(const std::string& url, bool limitProbe) {
     // Set options for low latency
     AVDictionary* opts = nullptr;
     av_dict_set(&opts, "rtsp_transport", "tcp", 0); // Prefer TCP for reliability
     av_dict_set(&opts, "buffer_size", "1024000", 0);
     av_dict_set(&opts, "max_delay", "500000", 0); // 0.5 sec
+    // SDP usually carries SPS/PPS, so a short probe is enough and shortens startup
+    if (limitProbe && probeSize > 0) av_dict_set(&opts, "probesize", std::to_string(probeSize).c_str(), 0);
+    if (limitProbe && analyzeDuration > 0) av_dict_set(&opts, "analyzeduration", std::to_string(analyzeDuration).c_str(), 0);
 
     std::cout << "[DEBUG-RTSP] calling avformat_open_input..." << std::endl;
     int ret = avformat_open_input(&fmtCtx, url.c_str(), nullptr, &opts);
@@ -47,11 +80,14 @@ bool RTSPStreamer::open(const std::string& url) {
         std::cerr << "No video stream found." << std::endl;
         return false;
     }
-
-    std::cout << "RTSP Stream opened. Video Stream Index: " << videoStreamIndex << std::endl;
     return true;
 }
 
+void RTSPStreamer::setProbeLimits(int64_t probeSizeBytes, int64_t analyzeDurationUs) {
+    probeSize = probeSizeBytes;
+    analyzeDuration = analyzeDurationUs;
+}
+
 AVCodecParameters* RTSPStreamer::getCodecParameters() {
     if (fmtCtx && videoStreamIndex >= 0) {
         return fmtCtx->streams[videoStreamIndex]->codecpar;
@@ -66,9 +102,22 @@ AVRational RTSPStreamer::getTimeBase() {
     return {1, 90000}; // Default fallback
 }
 
-void RTSPStreamer::start(SafeQueue<AVPacket*>& hlsQueue, SafeQueue<AVPacket*>& detectQueue) {
+void RTSPStreamer::setThreadTopology(const ThreadTopology* topology) {
+    this->topology = topology;
+}
+
+const StreamClock& RTSPStreamer::getClock() const {
+    return clock;
+}
+
+void RTSPStreamer::start(PacketQueue& hlsQueue, PacketQueue& detectQueue) {
+    shouldStop = false;
+    streamThread = std::thread(&RTSPStreamer::recordLoop, this, std::vector<PacketQueue*>{&hlsQueue, &detectQueue});
+}
+
+void RTSPStreamer::start(PacketQueue& queue) {
     shouldStop = false;
-    streamThread = std::thread(&RTSPStreamer::recordLoop, this, std::ref(hlsQueue), std::ref(detectQueue));
+    streamThread = std::thread(&RTSPStreamer::recordLoop, this, std::vector<PacketQueue*>{&queue});
 }
 
 void RTSPStreamer::stop() {
@@ -78,10 +127,27 @@ void RTSPStreamer::stop() {
     }
 }
 
-void RTSPStreamer::recordLoop(SafeQueue<AVPacket*>& hlsQueue, SafeQueue<AVPacket*>& detectQueue) {
+void RTSPStreamer::updateClock(const AVPacket* packet) {
+    // Read time right after av_read_frame; the clock keeps the smallest read-minus-pts
+    clock.observe(packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts, av_gettime());
+}
+
+void RTSPStreamer::recordLoop(std::vector<PacketQueue*> sinks) {
+    if (topology) {
+        topology->applyToCurrentThread(PipelineStage::Ingest);
+    }
+
     AVPacket* packet = av_packet_alloc();
+    // With ENABLE_ALLOC_COUNTER, every packet after the warm-up must not allocate
+    AllocationCounter::Loop allocCheck("ingest");
     while (!shouldStop) {
-        int ret = av_read_frame(fmtCtx, packet);
+        allocCheck.begin();
+        int ret;
+        {
+            // The demuxer allocates each payload buffer
+            AllocationCounter::Exempt exempt;
+            ret = av_read_frame(fmtCtx, packet);
+        }
         if (ret < 0) {
             std::cerr << "Error reading frame or EOF." << std::endl;
             // Attempt reconnect? For now just exit.
@@ -89,26 +155,34 @@ void RTSPStreamer::recordLoop(SafeQueue<AVPacket*>& hlsQueue, SafeQueue<AVPacket
         }
 
         if (packet->stream_index == videoStreamIndex) {
-            // We need to clone the packet for each consumer because they will own it and free it.
-            // Packet 1 for HLS
-            AVPacket* packetHLS = av_packet_clone(packet);
-            if (packetHLS) {
-                 hlsQueue.push(packetHLS);
-            }
-
-            // Packet 2 for Detection
-            // Only push if queue isn't full to avoid lag? 
-            // For now, push all, let consumer drop if too slow.
-            // Actually, we'll check size.
-            if (detectQueue.size() < 30) { // arbitrary limit to prevent OOM
-                AVPacket* packetDetect = av_packet_clone(packet);
-                if (packetDetect) {
-                    detectQueue.push(packetDetect);
+            updateClock(packet);
+
+            // Each consumer owns its packet. Extra sinks get a pooled packet referencing the
+            // same payload; the last one takes the read packet's reference outright.
+            // Queues enforce the memory budget and drop or block per their policy.
+            for (size_t i = 0; i < sinks.size(); i++) {
+                AVPacket* out = sinks[i]->pool().acquire();
+                if (!out) continue;
+                if (i + 1 < sinks.size()) {
+                    int refRet;
+                    {
+                        // Sharing the payload allocates FFmpeg's small buffer reference
+                        AllocationCounter::Exempt exempt;
+                        refRet = av_packet_ref(out, packet);
+                    }
+                    if (refRet < 0) {
+                        sinks[i]->pool().release(out);
+                        continue;
+                    }
+                } else {
+                    av_packet_move_ref(out, packet);
                 }
+                sinks[i]->push(out);
             }
         }
 
         av_packet_unref(packet);
+        allocCheck.end();
     }
     av_packet_free(&packet);
 }
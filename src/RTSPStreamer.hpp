@@ -3,7 +3,10 @@
 #include <string>
 #include <thread>
 #include <atomic>
-#include "SafeQueue.hpp"
+#include <vector>
+#include "PacketQueue.hpp"
+#include "StreamClock.hpp"
+#include "ThreadTopology.hpp"
 
 extern "C" {
 #include <libavformat/avformat.h>
@@ -17,18 +20,36 @@ public:
     ~RTSPStreamer();
 
     bool open(const std::string& url);
-    void start(SafeQueue<AVPacket*>& hlsQueue, SafeQueue<AVPacket*>& detectQueue);
+    // Caps stream probing in open(). 0 keeps FFmpeg's defaults (5 MB / 5 s). If the capped
+    // probe finds no frame size, open() probes once more with the defaults.
+    void setProbeLimits(int64_t probeSizeBytes, int64_t analyzeDurationUs);
+    // Single stream: every video packet goes to both queues
+    void start(PacketQueue& hlsQueue, PacketQueue& detectQueue);
+    // Dual stream: main stream feeds HLS only, substream feeds detection only
+    void start(PacketQueue& queue);
     void stop();
 
     AVCodecParameters* getCodecParameters();
     AVRational getTimeBase();
 
+    // Estimated wall-clock position of this stream's pts, fed by the ingest thread
+    const StreamClock& getClock() const;
+
+    // Optional: pin the ingest thread according to the given topology. Must outlive start().
+    void setThreadTopology(const ThreadTopology* topology);
+
 private:
     AVFormatContext* fmtCtx = nullptr;
     int videoStreamIndex = -1;
     std::string rtspUrl;
+    int64_t probeSize = 0;
+    int64_t analyzeDuration = 0;
     std::atomic<bool> shouldStop;
     std::thread streamThread;
+    const ThreadTopology* topology = nullptr;
+    StreamClock clock;
 
-    void recordLoop(SafeQueue<AVPacket*>& hlsQueue, SafeQueue<AVPacket*>& detectQueue);
+    bool openInput(const std::string& url, bool limitProbe);
+    void recordLoop(std::vector<PacketQueue*> sinks);
+    void updateClock(const AVPacket* packet);
 };
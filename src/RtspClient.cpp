@@ -0,0 +1,817 @@
+#include "RtspClient.hpp"
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <algorithm>
+#include <sstream>
+#include <mutex>
+#include <thread>
+#include <system_error>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+extern "C" {
+#include <libavutil/random_seed.h>
+#include <libavutil/base64.h>
+#include <libavutil/md5.h>
+#include <libavutil/mem.h>
+}
+
+// Bytes taken from the socket per handleEvents() call, so one busy stream cannot starve
+// the others on its I/O thread; poll() reports the rest on the next round
+static const size_t MAX_READ_PER_EVENT = 256 * 1024;
+static const size_t READ_CHUNK = 64 * 1024;
+static const size_t MAX_MESSAGE_HEADER = 64 * 1024;
+// Lets the kernel queue a stream's data while its thread serves other sessions
+static const int SOCKET_BUFFER_SIZE = 1024000;
+static const uint8_t START_CODE[4] = {0, 0, 0, 1};
+static const int64_t RTCP_INTERVAL_US = 5000000;
+static const char RTCP_CNAME[] = "rtsp_ingest";
+// A host with several addresses moves on to the next one if a connect takes this long
+static const int64_t ADDRESS_ATTEMPT_US = 3000000;
+
+static std::string toLower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
+    return s;
+}
+
+static std::string trim(const std::string& s) {
+    size_t b = s.find_first_not_of(" \t\r\n");
+    if (b == std::string::npos) return "";
+    size_t e = s.find_last_not_of(" \t\r\n");
+    return s.substr(b, e - b + 1);
+}
+
+static std::string md5Hex(const std::string& s) {
+    uint8_t digest[16];
+    av_md5_sum(digest, reinterpret_cast<const uint8_t*>(s.data()), s.size());
+    char hex[33];
+    for (int i = 0; i < 16; i++) snprintf(hex + i * 2, 3, "%02x", digest[i]);
+    return std::string(hex, 32);
+}
+
+// Value of key="value" or key=value in a comma-separated parameter list
+static std::string authParam(const std::string& params, const std::string& key) {
+    std::string lower = toLower(params);
+    size_t pos = 0;
+    while ((pos = lower.find(key + "=", pos)) != std::string::npos) {
+        if (pos == 0 || lower[pos - 1] == ' ' || lower[pos - 1] == ',') {
+            size_t v = pos + key.size() + 1;
+            if (v < params.size() && params[v] == '"') {
+                size_t end = params.find('"', v + 1);
+                return params.substr(v + 1, end == std::string::npos ? std::string::npos : end - v - 1);
+            }
+            size_t end = params.find(',', v);
+            return trim(params.substr(v, end == std::string::npos ? std::string::npos : end - v));
+        }
+        pos++;
+    }
+    return "";
+}
+
+// Credentials in the URL are percent-encoded (RFC 3986), e.g. "p%40ss" for "p@ss"
+static std::string percentDecode(const std::string& s) {
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '%' && i + 2 < s.size() && std::isxdigit(static_cast<unsigned char>(s[i + 1])) &&
+            std::isxdigit(static_cast<unsigned char>(s[i + 2]))) {
+            out += static_cast<char>(std::stoi(s.substr(i + 1, 2), nullptr, 16));
+            i += 2;
+        } else {
+            out += s[i];
+        }
+    }
+    return out;
+}
+
+// Lookup result shared by the client and its resolver thread, so either can finish first
+struct RtspClient::Resolver {
+    int eventFd = -1;
+    std::mutex mtx;
+    std::vector<Address> addresses;
+    std::string error;
+    ~Resolver() {
+        if (eventFd >= 0) ::close(eventFd);
+    }
+};
+
+const std::string* RtspClient::Response::header(const std::string& name) const {
+    for (const auto& h : headers) {
+        if (h.first == name) return &h.second;
+    }
+    return nullptr;
+}
+
+RtspClient::RtspClient(const std::string& url) : url(url) {}
+
+RtspClient::~RtspClient() {
+    close();
+    avcodec_parameters_free(&codecPar);
+}
+
+bool RtspClient::fail(const std::string& message) {
+    lastError = message;
+    return false;
+}
+
+bool RtspClient::parseUrl() {
+    char proto[16], auth[256], hostname[256], path[2048];
+    av_url_split(proto, sizeof(proto), auth, sizeof(auth), hostname, sizeof(hostname), &port,
+                 path, sizeof(path), url.c_str());
+    if (strcmp(proto, "rtsp") != 0 || hostname[0] == '\0') {
+        return fail("not an rtsp:// URL");
+    }
+    if (port < 0) port = 554;
+    host = hostname;
+
+    std::string credentials = auth;
+    size_t colon = credentials.find(':');
+    user = percentDecode(credentials.substr(0, colon));
+    password = colon == std::string::npos ? "" : percentDecode(credentials.substr(colon + 1));
+
+    std::string hostPart = host.find(':') != std::string::npos ? "[" + host + "]" : host;
+    requestUrl = "rtsp://" + hostPart + ":" + std::to_string(port) + (path[0] ? path : "/");
+    return true;
+}
+
+bool RtspClient::connect(int64_t nowUs) {
+    close();
+    lastError.clear();
+    unsupportedStream = false;
+    if (requestUrl.empty() && !parseUrl()) return false;
+
+    // Fresh session state; the parameter sets from a previous connection are kept until
+    // the new SDP or stream replaces them
+    outBuf.clear();
+    inBuf.clear();
+    inStart = 0;
+    authRetried = false;
+    authScheme.clear();
+    sessionId.clear();
+    baseUrl = requestUrl;
+    controlUrl.clear();
+    payloadType = -1;
+    rtpChannel = 0;
+    rtcpChannel = 1;
+    h264.reset();
+    ourSsrc = av_get_random_seed();
+    haveSource = false;
+    received = 0;
+    expectedPrior = 0;
+    receivedPrior = 0;
+    haveTransit = false;
+    jitter = 0;
+    lastSrUs = 0;
+    nextKeepaliveUs = nowUs;
+    lastMedia = 0;
+    addresses.clear();
+    nextAddress = 0;
+
+    // Literal addresses need no lookup; anything else goes to the resolver thread
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+    addrinfo* addrs = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addrs) == 0) {
+        addresses = addressList(addrs);
+        freeaddrinfo(addrs);
+        return connectNext("", nowUs);
+    }
+    return startResolve();
+}
+
+std::vector<RtspClient::Address> RtspClient::addressList(const addrinfo* list) {
+    std::vector<Address> out;
+    for (const addrinfo* a = list; a; a = a->ai_next) {
+        Address address;
+        address.family = a->ai_family;
+        const uint8_t* raw = reinterpret_cast<const uint8_t*>(a->ai_addr);
+        address.addr.assign(raw, raw + a->ai_addrlen);
+        out.push_back(std::move(address));
+    }
+    return out;
+}
+
+bool RtspClient::startResolve() {
+    std::shared_ptr<Resolver> r = std::make_shared<Resolver>();
+    r->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (r->eventFd < 0) return fail(std::string("eventfd: ") + strerror(errno));
+
+    std::string name = host;
+    std::string service = std::to_string(port);
+    try {
+        // Detached: a lookup cannot be cancelled, so a client that is closed or destroyed
+        // meanwhile just drops its reference and the thread cleans up after itself
+        std::thread([r, name, service]() {
+            addrinfo hints{};
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            addrinfo* addrs = nullptr;
+            int ret = getaddrinfo(name.c_str(), service.c_str(), &hints, &addrs);
+            {
+                std::lock_guard<std::mutex> lock(r->mtx);
+                if (ret == 0) {
+                    r->addresses = addressList(addrs);
+                } else {
+                    r->error = std::string("could not resolve ") + name + ": " + gai_strerror(ret);
+                }
+            }
+            if (addrs) freeaddrinfo(addrs);
+            uint64_t one = 1;
+            ssize_t n = write(r->eventFd, &one, sizeof(one));
+            (void)n;
+        }).detach();
+    } catch (const std::system_error& e) {
+        return fail(std::string("could not start resolver: ") + e.what());
+    }
+    resolver = std::move(r);
+    step = Step::Resolving;
+    return true;
+}
+
+bool RtspClient::finishResolve(int64_t nowUs) {
+    std::string error;
+    {
+        std::lock_guard<std::mutex> lock(resolver->mtx);
+        addresses.swap(resolver->addresses);
+        error = resolver->error;
+    }
+    resolver.reset();
+    step = Step::Idle;
+    if (addresses.empty()) return fail(error.empty() ? "could not resolve " + host : error);
+    return connectNext("", nowUs);
+}
+
+bool RtspClient::connectNext(std::string failure, int64_t nowUs) {
+    if (sock >= 0) {
+        ::close(sock);
+        sock = -1;
+    }
+    while (nextAddress < addresses.size()) {
+        const Address& a = addresses[nextAddress++];
+        sock = socket(a.family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (sock < 0) {
+            failure = std::string("socket: ") + strerror(errno);
+            continue;
+        }
+        int one = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &SOCKET_BUFFER_SIZE, sizeof(SOCKET_BUFFER_SIZE));
+
+        int ret = ::connect(sock, reinterpret_cast<const sockaddr*>(a.addr.data()), static_cast<socklen_t>(a.addr.size()));
+        if (ret < 0 && errno != EINPROGRESS) {
+            failure = std::string("connect: ") + strerror(errno);
+            ::close(sock);
+            sock = -1;
+            continue;
+        }
+        step = Step::Connecting;
+        attemptStartedUs = nowUs;
+        return true;
+    }
+    step = Step::Idle;
+    return fail(failure.empty() ? "no address to connect to" : failure);
+}
+
+void RtspClient::close() {
+    if (sock >= 0) {
+        ::close(sock);
+        sock = -1;
+    }
+    resolver.reset();
+    step = Step::Idle;
+}
+
+int RtspClient::fd() const {
+    return step == Step::Resolving ? resolver->eventFd : sock;
+}
+
+short RtspClient::pollEvents() const {
+    if (step == Step::Resolving) return POLLIN;
+    if (sock < 0) return 0;
+    if (step == Step::Connecting) return POLLOUT;
+    return POLLIN | (outBuf.empty() ? 0 : POLLOUT);
+}
+
+bool RtspClient::handleEvents(short revents, int64_t nowUs) {
+    if (step == Step::Resolving) {
+        if (!(revents & POLLIN)) return true;
+        return finishResolve(nowUs);
+    }
+    if (sock < 0) return fail("not connected");
+
+    if (step == Step::Connecting) {
+        if (!(revents & (POLLOUT | POLLERR | POLLHUP))) return true;
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0) return connectNext(std::string("connect: ") + strerror(err), nowUs);
+        step = Step::Describe;
+        sendRequest("DESCRIBE", requestUrl, "Accept: application/sdp\r\n");
+    }
+
+    if ((revents & POLLOUT) && !flushOutput()) return false;
+    if (revents & (POLLIN | POLLERR | POLLHUP)) {
+        if (!readInput()) return false;
+        if (!parseInput(nowUs)) return false;
+        if (h264.reordered()) {
+            unsupportedStream = true;
+            return fail("H.264 stream has B-frames");
+        }
+    }
+    // Replies queued while parsing go out right away if the socket takes them
+    if (!outBuf.empty() && !flushOutput()) return false;
+    return true;
+}
+
+bool RtspClient::tick(int64_t nowUs) {
+    if (step == Step::Connecting && nextAddress < addresses.size() && nowUs >= attemptStartedUs + ADDRESS_ATTEMPT_US) {
+        return connectNext("connect timed out", nowUs);
+    }
+    if (step != Step::Playing) return true;
+    if (nowUs >= nextReportUs) {
+        sendReceiverReport(nowUs);
+        nextReportUs = nowUs + RTCP_INTERVAL_US;
+    }
+    if (nowUs >= nextKeepaliveUs) {
+        // OPTIONS is the keepalive every server accepts; its response is ignored
+        sendRequest("OPTIONS", requestUrl, "");
+        nextKeepaliveUs = nowUs + keepaliveIntervalUs;
+    }
+    return flushOutput();
+}
+
+int64_t RtspClient::nextTimerUs() const {
+    if (step == Step::Connecting && nextAddress < addresses.size()) return attemptStartedUs + ADDRESS_ATTEMPT_US;
+    return step == Step::Playing ? std::min(nextKeepaliveUs, nextReportUs) : INT64_MAX;
+}
+
+bool RtspClient::flushOutput() {
+    while (!outBuf.empty()) {
+        ssize_t n = send(sock, outBuf.data(), outBuf.size(), MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            if (errno == EINTR) continue;
+            return fail(std::string("send: ") + strerror(errno));
+        }
+        outBuf.erase(0, static_cast<size_t>(n));
+    }
+    return true;
+}
+
+bool RtspClient::readInput() {
+    // Compact what the parser already consumed before growing the buffer
+    if (inStart > 0) {
+        inBuf.erase(inBuf.begin(), inBuf.begin() + inStart);
+        inStart = 0;
+    }
+
+    size_t total = 0;
+    while (total < MAX_READ_PER_EVENT) {
+        size_t old = inBuf.size();
+        inBuf.resize(old + READ_CHUNK);
+        ssize_t n = recv(sock, inBuf.data() + old, READ_CHUNK, 0);
+        if (n <= 0) {
+            inBuf.resize(old);
+            if (n == 0) return fail("connection closed by server");
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == EINTR) continue;
+            return fail(std::string("recv: ") + strerror(errno));
+        }
+        inBuf.resize(old + static_cast<size_t>(n));
+        total += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool RtspClient::parseInput(int64_t nowUs) {
+    while (inStart < inBuf.size()) {
+        const uint8_t* p = inBuf.data() + inStart;
+        size_t avail = inBuf.size() - inStart;
+
+        if (p[0] == '$') {
+            // Interleaved binary frame: '$', channel, 16-bit length
+            if (avail < 4) break;
+            size_t len = (static_cast<size_t>(p[2]) << 8) | p[3];
+            if (avail < 4 + len) break;
+            if (p[1] == rtpChannel && step == Step::Playing) {
+                lastMedia = nowUs;
+                handleRtp(p + 4, len, nowUs);
+            } else if (p[1] == rtcpChannel && step == Step::Playing) {
+                handleRtcp(p + 4, len, nowUs);
+            }
+            inStart += 4 + len;
+            continue;
+        }
+
+        // RTSP message (a response, or a request from the server)
+        const uint8_t* headerEnd = nullptr;
+        for (size_t i = 0; i + 3 < avail; i++) {
+            if (p[i] == '\r' && p[i + 1] == '\n' && p[i + 2] == '\r' && p[i + 3] == '\n') {
+                headerEnd = p + i + 4;
+                break;
+            }
+        }
+        if (!headerEnd) {
+            if (avail > MAX_MESSAGE_HEADER) return fail("malformed RTSP message");
+            break;
+        }
+
+        std::string head(reinterpret_cast<const char*>(p), headerEnd - p);
+        Response msg;
+        std::istringstream lines(head);
+        std::string line;
+        std::getline(lines, line);
+        msg.statusLine = trim(line);
+        while (std::getline(lines, line)) {
+            size_t colon = line.find(':');
+            if (colon == std::string::npos) continue;
+            msg.headers.emplace_back(toLower(trim(line.substr(0, colon))), trim(line.substr(colon + 1)));
+        }
+        size_t bodyLen = 0;
+        if (const std::string* cl = msg.header("content-length")) {
+            bodyLen = static_cast<size_t>(std::strtoul(cl->c_str(), nullptr, 10));
+        }
+        size_t headLen = headerEnd - p;
+        if (avail < headLen + bodyLen) break;
+        msg.body.assign(reinterpret_cast<const char*>(headerEnd), bodyLen);
+        inStart += headLen + bodyLen;
+
+        if (msg.statusLine.compare(0, 5, "RTSP/") == 0) {
+            msg.status = std::atoi(msg.statusLine.c_str() + msg.statusLine.find(' ') + 1);
+            if (!handleResponse(msg, nowUs)) return false;
+        } else {
+            // Server-initiated request (e.g. OPTIONS, SET_PARAMETER): acknowledge it
+            const std::string* seq = msg.header("cseq");
+            outBuf += "RTSP/1.0 200 OK\r\nCSeq: " + (seq ? *seq : std::string("0")) + "\r\n\r\n";
+        }
+    }
+    return true;
+}
+
+void RtspClient::sendRequest(const std::string& method, const std::string& uri, const std::string& extraHeaders) {
+    pendingMethod = method;
+    pendingUri = uri;
+    pendingHeaders = extraHeaders;
+
+    std::string req = method + " " + uri + " RTSP/1.0\r\n";
+    req += "CSeq: " + std::to_string(++cseq) + "\r\n";
+    req += "User-Agent: rtsp_ingest\r\n";
+    if (!sessionId.empty()) req += "Session: " + sessionId + "\r\n";
+    req += authorization(method, uri);
+    req += extraHeaders;
+    req += "\r\n";
+    outBuf += req;
+}
+
+std::string RtspClient::authorization(const std::string& method, const std::string& uri) {
+    if (authScheme == "basic") {
+        std::string credentials = user + ":" + password;
+        std::vector<char> encoded(AV_BASE64_SIZE(credentials.size()));
+        av_base64_encode(encoded.data(), static_cast<int>(encoded.size()),
+                         reinterpret_cast<const uint8_t*>(credentials.data()), static_cast<int>(credentials.size()));
+        return std::string("Authorization: Basic ") + encoded.data() + "\r\n";
+    }
+    if (authScheme == "digest") {
+        std::string ha1 = md5Hex(user + ":" + realm + ":" + password);
+        std::string ha2 = md5Hex(method + ":" + uri);
+        std::string header = "Authorization: Digest username=\"" + user + "\", realm=\"" + realm +
+                             "\", nonce=\"" + nonce + "\", uri=\"" + uri + "\"";
+        if (qopAuth) {
+            char nc[9];
+            snprintf(nc, sizeof(nc), "%08x", ++nonceCount);
+            std::string cnonce = md5Hex(nonce + nc).substr(0, 16);
+            header += ", qop=auth, nc=" + std::string(nc) + ", cnonce=\"" + cnonce + "\", response=\"" +
+                      md5Hex(ha1 + ":" + nonce + ":" + nc + ":" + cnonce + ":auth:" + ha2) + "\"";
+        } else {
+            header += ", response=\"" + md5Hex(ha1 + ":" + nonce + ":" + ha2) + "\"";
+        }
+        if (!opaque.empty()) header += ", opaque=\"" + opaque + "\"";
+        return header + "\r\n";
+    }
+    return "";
+}
+
+bool RtspClient::parseChallenge(const Response& response) {
+    // Prefer Digest when the server offers both
+    std::string basic, digest;
+    for (const auto& h : response.headers) {
+        if (h.first != "www-authenticate") continue;
+        std::string scheme = toLower(h.second.substr(0, h.second.find(' ')));
+        if (scheme == "digest") digest = h.second.substr(h.second.find(' ') + 1);
+        if (scheme == "basic") basic = h.second;
+    }
+    if (!digest.empty()) {
+        authScheme = "digest";
+        realm = authParam(digest, "realm");
+        nonce = authParam(digest, "nonce");
+        opaque = authParam(digest, "opaque");
+        qopAuth = toLower(authParam(digest, "qop")).find("auth") != std::string::npos;
+        nonceCount = 0;
+        return true;
+    }
+    if (!basic.empty()) {
+        authScheme = "basic";
+        return true;
+    }
+    return false;
+}
+
+bool RtspClient::handleResponse(const Response& response, int64_t nowUs) {
+    // Keepalive replies, or anything else once streaming, need no action
+    if (step == Step::Playing) return true;
+
+    if (response.status == 401) {
+        if (authRetried || user.empty() || !parseChallenge(response)) {
+            return fail(pendingMethod + " unauthorized: " + response.statusLine);
+        }
+        authRetried = true;
+        sendRequest(pendingMethod, pendingUri, pendingHeaders);
+        return true;
+    }
+    if (response.status != 200) {
+        return fail(pendingMethod + " failed: " + response.statusLine);
+    }
+    authRetried = false;
+
+    switch (step) {
+    case Step::Describe: {
+        if (const std::string* cb = response.header("content-base")) {
+            baseUrl = *cb;
+        } else if (const std::string* cl = response.header("content-location")) {
+            baseUrl = *cl;
+        }
+        if (!parseSdp(response.body)) return false;
+        step = Step::Setup;
+        sendRequest("SETUP", controlUrl, "Transport: RTP/AVP/TCP;unicast;interleaved=0-1\r\n");
+        return true;
+    }
+    case Step::Setup: {
+        const std::string* session = response.header("session");
+        if (!session) return fail("SETUP response without a session");
+        sessionId = session->substr(0, session->find(';'));
+        size_t timeoutPos = session->find("timeout=");
+        if (timeoutPos != std::string::npos) {
+            int64_t timeoutSec = std::atoll(session->c_str() + timeoutPos + 8);
+            if (timeoutSec > 0) keepaliveIntervalUs = timeoutSec * 1000000 / 2;
+        }
+        // The server may pick other channels than the ones asked for
+        if (const std::string* transport = response.header("transport")) {
+            size_t pos = transport->find("interleaved=");
+            if (pos != std::string::npos) {
+                char* end = nullptr;
+                rtpChannel = static_cast<int>(std::strtol(transport->c_str() + pos + 12, &end, 10));
+                rtcpChannel = *end == '-' ? std::atoi(end + 1) : rtpChannel + 1;
+            }
+        }
+        step = Step::Play;
+        sendRequest("PLAY", baseUrl, "Range: npt=0.000-\r\n");
+        return true;
+    }
+    case Step::Play:
+        step = Step::Playing;
+        nextKeepaliveUs = nowUs + keepaliveIntervalUs;
+        nextReportUs = nowUs + RTCP_INTERVAL_US;
+        return true;
+    default:
+        return true;
+    }
+}
+
+std::string RtspClient::resolveControl(const std::string& control) const {
+    if (control.empty() || control == "*") return baseUrl;
+    if (control.compare(0, 7, "rtsp://") == 0) return control;
+    if (!baseUrl.empty() && baseUrl.back() == '/') return baseUrl + control;
+    return baseUrl + "/" + control;
+}
+
+bool RtspClient::parseSdp(const std::string& sdp) {
+    std::istringstream lines(sdp);
+    std::string line;
+    bool inVideo = false;
+    bool found = false;
+    std::string control;
+    std::string fmtp;
+    int pt = -1;
+    std::string videoEncoding;
+
+    while (std::getline(lines, line)) {
+        line = trim(line);
+        if (line.compare(0, 2, "m=") == 0) {
+            if (found) break; // first H.264 video section wins
+            inVideo = line.compare(0, 8, "m=video ") == 0;
+            control.clear();
+            fmtp.clear();
+            continue;
+        }
+        if (!inVideo) continue;
+
+        if (line.compare(0, 9, "a=rtpmap:") == 0) {
+            int candidate = std::atoi(line.c_str() + 9);
+            std::string encoding = toLower(line.substr(line.find(' ') + 1));
+            if (videoEncoding.empty()) videoEncoding = encoding.substr(0, encoding.find('/'));
+            if (encoding.compare(0, 5, "h264/") == 0) {
+                pt = candidate;
+                found = true;
+            }
+        } else if (line.compare(0, 7, "a=fmtp:") == 0) {
+            fmtp = line;
+        } else if (line.compare(0, 10, "a=control:") == 0) {
+            control = line.substr(10);
+        }
+    }
+    if (!found) {
+        unsupportedStream = true;
+        return fail(videoEncoding.empty() ? "no H.264 video track in the SDP" : "video codec " + videoEncoding + " is not supported");
+    }
+
+    payloadType = pt;
+    controlUrl = resolveControl(control);
+
+    // Parameter sets from the SDP; streams without them carry them in-band
+    size_t pos = fmtp.find("sprop-parameter-sets=");
+    if (pos != std::string::npos) {
+        std::string sets = fmtp.substr(pos + 21);
+        sets = sets.substr(0, sets.find(';'));
+        std::istringstream parts(sets);
+        std::string part;
+        while (std::getline(parts, part, ',')) {
+            std::vector<uint8_t> nal(part.size());
+            int len = av_base64_decode(nal.data(), trim(part).c_str(), static_cast<int>(nal.size()));
+            if (len > 0) h264.addParameterSet(nal.data(), static_cast<size_t>(len));
+        }
+    }
+    updateExtradata();
+    return true;
+}
+
+void RtspClient::updateExtradata() {
+    if (!codecPar) {
+        codecPar = avcodec_parameters_alloc();
+        if (!codecPar) return;
+    }
+    codecPar->codec_type = AVMEDIA_TYPE_VIDEO;
+    codecPar->codec_id = AV_CODEC_ID_H264;
+
+    av_freep(&codecPar->extradata);
+    codecPar->extradata_size = 0;
+    const std::string& sps = h264.sps();
+    const std::string& pps = h264.pps();
+    if (sps.empty() || pps.empty()) return;
+
+    size_t size = 8 + sps.size() + pps.size();
+    codecPar->extradata = static_cast<uint8_t*>(av_mallocz(size + AV_INPUT_BUFFER_PADDING_SIZE));
+    if (!codecPar->extradata) return;
+    uint8_t* out = codecPar->extradata;
+    memcpy(out, START_CODE, 4);
+    memcpy(out + 4, sps.data(), sps.size());
+    memcpy(out + 4 + sps.size(), START_CODE, 4);
+    memcpy(out + 8 + sps.size(), pps.data(), pps.size());
+    codecPar->extradata_size = static_cast<int>(size);
+}
+
+void RtspClient::handleRtp(const uint8_t* data, size_t size, int64_t nowUs) {
+    if (size < 12 || (data[0] >> 6) != 2) return;
+
+    bool padding = data[0] & 0x20;
+    bool extension = data[0] & 0x10;
+    size_t csrcCount = data[0] & 0x0f;
+    bool marker = data[1] & 0x80;
+    int pt = data[1] & 0x7f;
+    uint16_t seq = static_cast<uint16_t>((data[2] << 8) | data[3]);
+    uint32_t timestamp = (static_cast<uint32_t>(data[4]) << 24) | (data[5] << 16) | (data[6] << 8) | data[7];
+    if (pt != payloadType) return;
+
+    size_t offset = 12 + 4 * csrcCount;
+    if (extension) {
+        if (offset + 4 > size) return;
+        offset += 4 + 4 * ((static_cast<size_t>(data[offset + 2]) << 8) | data[offset + 3]);
+    }
+    size_t end = size;
+    if (padding) {
+        if (data[size - 1] > size) return;
+        end -= data[size - 1];
+    }
+    if (offset >= end) return;
+
+    // Receiver statistics for RTCP: sequence cycles, packet count and interarrival jitter
+    uint32_t ssrc = (static_cast<uint32_t>(data[8]) << 24) | (data[9] << 16) | (data[10] << 8) | data[11];
+    if (!haveSource || ssrc != sourceSsrc) {
+        haveSource = true;
+        sourceSsrc = ssrc;
+        baseSeq = seq;
+        maxSeq = seq;
+        seqCycles = 0;
+        received = 0;
+        expectedPrior = 0;
+        receivedPrior = 0;
+        haveTransit = false;
+        jitter = 0;
+    } else if (static_cast<uint16_t>(seq - maxSeq) < 0x8000) {
+        if (seq < maxSeq) seqCycles += 0x10000;
+        maxSeq = seq;
+    }
+    received++;
+    int64_t transit = nowUs * 9 / 100 - timestamp; // arrival in 90 kHz units
+    if (haveTransit) {
+        int64_t d = transit - lastTransit;
+        jitter += (static_cast<double>(d < 0 ? -d : d) - jitter) / 16;
+    }
+    haveTransit = true;
+    lastTransit = transit;
+
+    h264.push(data + offset, end - offset, seq, timestamp, marker);
+}
+
+void RtspClient::handleRtcp(const uint8_t* data, size_t size, int64_t nowUs) {
+    // Compound packet: only the sender report matters, for LSR/DLSR in our reports
+    size_t pos = 0;
+    while (pos + 4 <= size && (data[pos] >> 6) == 2) {
+        size_t len = 4 * ((static_cast<size_t>(data[pos + 2]) << 8 | data[pos + 3]) + 1);
+        if (pos + len > size) break;
+        if (data[pos + 1] == 200 && len >= 28) {
+            const uint8_t* ntp = data + pos + 8;
+            lastSrNtp = (static_cast<uint32_t>(ntp[2]) << 24) | (ntp[3] << 16) | (ntp[4] << 8) | ntp[5];
+            lastSrUs = nowUs;
+        }
+        pos += len;
+    }
+}
+
+void RtspClient::sendReceiverReport(int64_t nowUs) {
+    uint8_t packet[64];
+    size_t n = 0;
+    auto put32 = [&](uint32_t v) {
+        packet[n++] = static_cast<uint8_t>(v >> 24);
+        packet[n++] = static_cast<uint8_t>(v >> 16);
+        packet[n++] = static_cast<uint8_t>(v >> 8);
+        packet[n++] = static_cast<uint8_t>(v);
+    };
+
+    // RR with one report block (or none before any RTP arrived)
+    int blocks = haveSource ? 1 : 0;
+    put32(0x80000000u | (blocks << 24) | (201 << 16) | (1 + 6 * blocks));
+    put32(ourSsrc);
+    if (haveSource) {
+        uint32_t extendedMax = seqCycles + maxSeq;
+        uint32_t expected = extendedMax - baseSeq + 1;
+        int64_t lost = static_cast<int64_t>(expected) - received;
+        lost = std::max<int64_t>(-0x800000, std::min<int64_t>(0x7fffff, lost));
+        uint32_t expectedInterval = expected - expectedPrior;
+        uint32_t receivedInterval = received - receivedPrior;
+        expectedPrior = expected;
+        receivedPrior = received;
+        int64_t lostInterval = static_cast<int64_t>(expectedInterval) - receivedInterval;
+        uint32_t fraction = expectedInterval == 0 || lostInterval <= 0
+                                ? 0 : static_cast<uint32_t>((lostInterval << 8) / expectedInterval);
+        uint32_t dlsr = lastSrUs ? static_cast<uint32_t>((nowUs - lastSrUs) * 65536 / 1000000) : 0;
+
+        put32(sourceSsrc);
+        put32((std::min<uint32_t>(fraction, 255) << 24) | (static_cast<uint32_t>(lost) & 0xffffff));
+        put32(extendedMax);
+        put32(static_cast<uint32_t>(jitter));
+        put32(lastSrUs ? lastSrNtp : 0);
+        put32(dlsr);
+    }
+
+    // SDES with our CNAME: every compound packet must carry one
+    size_t sdes = n;
+    size_t nameLen = sizeof(RTCP_CNAME) - 1;
+    size_t chunk = 4 + 2 + nameLen + 1;  // SSRC, CNAME item, end of list
+    size_t words = (chunk + 3) / 4;
+    put32(0x81000000u | (202 << 16) | static_cast<uint32_t>(words));
+    put32(ourSsrc);
+    packet[n++] = 1;
+    packet[n++] = static_cast<uint8_t>(nameLen);
+    memcpy(packet + n, RTCP_CNAME, nameLen);
+    n += nameLen;
+    while (n < sdes + 4 + words * 4) packet[n++] = 0;
+
+    char header[4] = {'$', static_cast<char>(rtcpChannel), static_cast<char>(n >> 8), static_cast<char>(n)};
+    outBuf.append(header, 4);
+    outBuf.append(reinterpret_cast<const char*>(packet), n);
+}
+
+bool RtspClient::readPacket(AVPacket* packet) {
+    H264Depacketizer::AccessUnit unit;
+    if (!h264.pop(unit)) return false;
+    if (av_new_packet(packet, static_cast<int>(unit.data.size())) < 0) return false;
+    memcpy(packet->data, unit.data.data(), unit.data.size());
+    packet->pts = unit.pts;
+    packet->dts = unit.pts;
+    if (unit.keyframe) packet->flags |= AV_PKT_FLAG_KEY;
+    return true;
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <memory>
+
+#include "H264Depacketizer.hpp"
+
+struct addrinfo;
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+}
+
+// Minimal non-blocking RTSP client for H.264 over RTP/TCP (interleaved channels). It owns
+// its socket but not its thread: the caller polls fd() for pollEvents(), calls
+// handleEvents() when the socket is ready and tick() on its timers, and pulls complete
+// access units with readPacket(). Nothing in here waits on the network, so one thread can
+// serve any number of sessions and readiness comes straight from the kernel.
+//
+// Supported: Basic and Digest authentication, one H.264 video track (see H264Depacketizer),
+// SPS/PPS from the SDP or in-band. Not supported: UDP transport,
+// other codecs, and B-frames (pts is the unwrapped RTP timestamp and dts = pts); such
+// streams are reported through unsupported() so the caller can use another client. RTCP
+// receiver reports go out every 5 s on the interleaved RTCP channel, which also keeps
+// servers that time out silent receivers from dropping the session.
+// Host names are resolved on a short-lived helper thread; while that runs, fd() is an
+// eventfd that becomes readable when the addresses are in. Each address is tried in turn.
+class RtspClient {
+public:
+    explicit RtspClient(const std::string& url);
+    ~RtspClient();
+
+    RtspClient(const RtspClient&) = delete;
+    RtspClient& operator=(const RtspClient&) = delete;
+
+    // Starts resolving and connecting without blocking. Returns false if the URL is invalid
+    // or no connection attempt could be started; see error().
+    bool connect(int64_t nowUs);
+    void close();
+
+    int fd() const;
+    short pollEvents() const;
+
+    // Reads and writes whatever the socket allows. Returns false on a protocol error or
+    // when the server closes the connection; see error().
+    bool handleEvents(short revents, int64_t nowUs);
+    // Sends keepalives when due. Returns false on a fatal error.
+    bool tick(int64_t nowUs);
+    // Next time tick() has something to do, or INT64_MAX
+    int64_t nextTimerUs() const;
+
+    // True once the server accepted PLAY
+    bool playing() const { return step == Step::Playing; }
+    // Valid once playing(): H.264, with the SDP's SPS/PPS as Annex B extradata if present
+    const AVCodecParameters* codecParameters() const { return codecPar; }
+    AVRational timeBase() const { return {1, 90000}; }
+
+    // Next complete access unit (Annex B, pts/dts in timeBase()). Returns false if none is
+    // buffered. Data before the first keyframe and after a sequence gap up to the next
+    // keyframe is dropped.
+    bool readPacket(AVPacket* packet);
+
+    // Last time RTP video arrived, including data dropped while waiting for a keyframe
+    int64_t lastMediaUs() const { return lastMedia; }
+
+    const std::string& error() const { return lastError; }
+
+    // Set when the connection failed because the stream itself is beyond this client (no
+    // H.264 track, or H.264 with B-frames); error() says why. Retrying will not help.
+    bool unsupported() const { return unsupportedStream; }
+
+private:
+    enum class Step { Idle, Resolving, Connecting, Describe, Setup, Play, Playing };
+
+    struct Address {
+        int family = 0;
+        std::vector<uint8_t> addr; // sockaddr of the family
+    };
+    struct Resolver; // shared with the resolver thread
+
+    struct Response {
+        int status = 0;
+        std::string statusLine;
+        std::vector<std::pair<std::string, std::string>> headers; // names lowercased
+        std::string body;
+        const std::string* header(const std::string& name) const;
+    };
+
+    // Connection
+    std::string url;        // as given, possibly with credentials
+    std::string requestUrl; // without credentials
+    std::string host;
+    int port = 554;
+    std::string user;
+    std::string password;
+    int sock = -1;
+    Step step = Step::Idle;
+    std::shared_ptr<Resolver> resolver;
+    std::vector<Address> addresses;
+    size_t nextAddress = 0;
+    int64_t attemptStartedUs = 0;
+    std::string lastError;
+    bool unsupportedStream = false;
+
+    // RTSP
+    std::string outBuf;
+    std::vector<uint8_t> inBuf;
+    size_t inStart = 0;
+    int cseq = 0;
+    std::string pendingMethod;
+    std::string pendingUri;
+    std::string pendingHeaders;
+    bool authRetried = false;
+    std::string authScheme; // "", "basic" or "digest"
+    std::string realm;
+    std::string nonce;
+    std::string opaque;
+    bool qopAuth = false;
+    int nonceCount = 0;
+    std::string baseUrl;
+    std::string controlUrl;
+    std::string sessionId;
+    int64_t keepaliveIntervalUs = 30000000;
+    int64_t nextKeepaliveUs = 0;
+
+    // RTP / H.264
+    int payloadType = -1;
+    int rtpChannel = 0;
+    AVCodecParameters* codecPar = nullptr;
+    int64_t lastMedia = 0;
+    H264Depacketizer h264;
+
+    // RTCP receiver statistics (RFC 3550 appendix A), reported on rtcpChannel
+    int rtcpChannel = 1;
+    uint32_t ourSsrc = 0;
+    bool haveSource = false;
+    uint32_t sourceSsrc = 0;
+    uint16_t baseSeq = 0;
+    uint16_t maxSeq = 0;
+    uint32_t seqCycles = 0;
+    uint32_t received = 0;
+    uint32_t expectedPrior = 0;
+    uint32_t receivedPrior = 0;
+    bool haveTransit = false;
+    int64_t lastTransit = 0;
+    double jitter = 0;
+    uint32_t lastSrNtp = 0;   // middle 32 bits of the last sender report's NTP time
+    int64_t lastSrUs = 0;
+    int64_t nextReportUs = 0;
+
+    bool fail(const std::string& message);
+    bool parseUrl();
+    bool startResolve();
+    bool finishResolve(int64_t nowUs);
+    bool connectNext(std::string failure, int64_t nowUs);
+    static std::vector<Address> addressList(const addrinfo* list);
+    bool flushOutput();
+    bool readInput();
+    bool parseInput(int64_t nowUs);
+    void sendRequest(const std::string& method, const std::string& uri, const std::string& extraHeaders);
+    std::string authorization(const std::string& method, const std::string& uri);
+    bool parseChallenge(const Response& response);
+    bool handleResponse(const Response& response, int64_t nowUs);
+    bool parseSdp(const std::string& sdp);
+    std::string resolveControl(const std::string& control) const;
+
+    void handleRtp(const uint8_t* data, size_t size, int64_t nowUs);
+    void handleRtcp(const uint8_t* data, size_t size, int64_t nowUs);
+    void sendReceiverReport(int64_t nowUs);
+    void updateExtradata();
+};
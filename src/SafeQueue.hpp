@@ -16,6 +16,18 @@ public:
         cond.notify_one();
     }
 
+    // Pushes only while fewer than maxSize items are queued (0 = no limit).
+    // Returns false, dropping the value, when the queue is full.
+    bool tryPush(T value, size_t maxSize) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (maxSize > 0 && queue.size() >= maxSize) {
+            return false;
+        }
+        queue.push(std::move(value));
+        cond.notify_one();
+        return true;
+    }
+
     // Returns true if value was retrieved, false if queue is stopped and empty
     bool pop(T& value) {
         std::unique_lock<std::mutex> lock(mtx);
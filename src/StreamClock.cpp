@@ -0,0 +1,68 @@
+#include "StreamClock.hpp"
+#include <algorithm>
+
+static const AVRational MICROSECONDS = {1, 1000000};
+
+void StreamClock::setTimeBase(AVRational tb) {
+    std::lock_guard<std::mutex> lock(mtx);
+    timeBase = tb;
+}
+
+AVRational StreamClock::getTimeBase() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return timeBase;
+}
+
+void StreamClock::observe(int64_t pts, int64_t wallclockUs) {
+    if (pts == AV_NOPTS_VALUE) return;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    int64_t offset = wallclockUs - av_rescale_q(pts, timeBase, MICROSECONDS);
+
+    if (currentMin == NO_OFFSET && previousMin == NO_OFFSET) {
+        windowStartUs = wallclockUs;
+        firstObservedUs = wallclockUs;
+    } else if (wallclockUs - windowStartUs >= WINDOW_US) {
+        previousMin = currentMin;
+        currentMin = NO_OFFSET;
+        windowStartUs = wallclockUs;
+    }
+    currentMin = std::min(currentMin, offset);
+    lastObservedUs = wallclockUs;
+}
+
+int64_t StreamClock::offsetLocked() const {
+    return std::min(currentMin, previousMin);
+}
+
+bool StreamClock::settledLocked() const {
+    return offsetLocked() != NO_OFFSET && lastObservedUs - firstObservedUs >= SETTLE_US;
+}
+
+bool StreamClock::hasEstimate() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return settledLocked();
+}
+
+int64_t StreamClock::convertTo(int64_t pts, const StreamClock& target) const {
+    if (&target == this) return pts;
+    if (pts == AV_NOPTS_VALUE) return AV_NOPTS_VALUE;
+
+    int64_t fromOffset, toOffset;
+    AVRational fromTb, toTb;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!settledLocked()) return AV_NOPTS_VALUE;
+        fromOffset = offsetLocked();
+        fromTb = timeBase;
+    }
+    {
+        std::lock_guard<std::mutex> lock(target.mtx);
+        if (!target.settledLocked()) return AV_NOPTS_VALUE;
+        toOffset = target.offsetLocked();
+        toTb = target.timeBase;
+    }
+
+    int64_t wallclockUs = av_rescale_q(pts, fromTb, MICROSECONDS) + fromOffset;
+    return av_rescale_q(wallclockUs - toOffset, MICROSECONDS, toTb);
+}
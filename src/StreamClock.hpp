@@ -0,0 +1,57 @@
+#pragma once
+
+#include <mutex>
+#include <cstdint>
+
+extern "C" {
+#include <libavutil/avutil.h>
+}
+
+// Estimates where a stream's pts falls on our wall clock, so packets from two RTSP
+// sessions of the same camera (main stream and substream) can be related to each other.
+//
+// Neither session's pts is tied to a known instant: FFmpeg's RTSP pts starts from a
+// per-session offset even when RTCP sender reports are used, and the first packet read may
+// have been buffered during probing. Instead, every packet read gives an upper bound on the
+// offset between wall clock and pts (a packet cannot be read before it is captured), and the
+// smallest one seen is the estimate, which filters out network, buffering and reading delays.
+//
+// A pts converted between two streams is therefore off by the difference in their minimum
+// capture-to-read latency (encoder delay plus transit), typically a few tens of
+// milliseconds for two streams of one camera on one network path. The minimum is taken over
+// a sliding 30-60 s window so camera clock drift and pts discontinuities age out.
+class StreamClock {
+public:
+    StreamClock() = default;
+
+    void setTimeBase(AVRational tb);
+    AVRational getTimeBase() const;
+
+    // Feeds the pts of a packet as it is read; wallclockUs is microseconds since epoch.
+    void observe(int64_t pts, int64_t wallclockUs);
+    // True once packets have been observed for SETTLE_US: the minimum over the first few
+    // packets still includes the startup burst and is not an estimate yet.
+    bool hasEstimate() const;
+
+    // Converts a pts of this stream into the pts of `target` at (approximately) the same
+    // instant. Returns AV_NOPTS_VALUE until both streams have an estimate (a stream converts
+    // to itself unchanged).
+    int64_t convertTo(int64_t pts, const StreamClock& target) const;
+
+private:
+    static const int64_t WINDOW_US = 30 * 1000000LL;
+    static const int64_t SETTLE_US = 5 * 1000000LL;
+    static const int64_t NO_OFFSET = INT64_MAX;
+
+    mutable std::mutex mtx;
+    AVRational timeBase{1, 90000};
+    // Smallest wall-clock minus pts (in microseconds) in the current and previous window
+    int64_t windowStartUs = 0;
+    int64_t currentMin = NO_OFFSET;
+    int64_t previousMin = NO_OFFSET;
+    int64_t firstObservedUs = 0;
+    int64_t lastObservedUs = 0;
+
+    int64_t offsetLocked() const;
+    bool settledLocked() const;
+};
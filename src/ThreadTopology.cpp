@@ -0,0 +1,169 @@
+#include "ThreadTopology.hpp"
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+const char* envSuffix(PipelineStage s) {
+    switch (s) {
+        case PipelineStage::Ingest:    return "INGEST";
+        case PipelineStage::Decode:    return "DECODE";
+        case PipelineStage::Inference: return "INFERENCE";
+        case PipelineStage::Mux:       return "MUX";
+        case PipelineStage::DbWriter:  return "DB_WRITER";
+        default:                       return "";
+    }
+}
+
+#ifdef __linux__
+std::vector<int> currentAffinity() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+        for (int i = 0; i < CPU_SETSIZE; ++i) {
+            if (CPU_ISSET(i, &set)) cpus.push_back(i);
+        }
+    }
+    return cpus;
+}
+#endif
+
+} // namespace
+
+const char* ThreadTopology::stageName(PipelineStage s) {
+    switch (s) {
+        case PipelineStage::Ingest:    return "ingest";
+        case PipelineStage::Decode:    return "decode";
+        case PipelineStage::Inference: return "inference";
+        case PipelineStage::Mux:       return "mux";
+        case PipelineStage::DbWriter:  return "db-writer";
+        default:                       return "unknown";
+    }
+}
+
+void ThreadTopology::loadFromEnv() {
+    for (int i = 0; i < static_cast<int>(PipelineStage::Count); ++i) {
+        PipelineStage s = static_cast<PipelineStage>(i);
+        StageConfig& cfg = stages[i];
+
+        std::string cpuKey = std::string("PIPELINE_CPUS_") + envSuffix(s);
+        if (const char* val = std::getenv(cpuKey.c_str())) {
+            if (!parseCpuList(val, cfg.cpus)) {
+                std::cerr << "[TOPOLOGY] Ignoring invalid " << cpuKey << "='" << val << "'" << std::endl;
+                cfg.cpus.clear();
+            }
+        }
+
+        std::string threadKey = std::string("PIPELINE_THREADS_") + envSuffix(s);
+        if (const char* val = std::getenv(threadKey.c_str())) {
+            int n = std::atoi(val);
+            if (n > 0) {
+                cfg.threads = n;
+            } else {
+                std::cerr << "[TOPOLOGY] Ignoring invalid " << threadKey << "='" << val << "'" << std::endl;
+            }
+        }
+    }
+}
+
+const StageConfig& ThreadTopology::stage(PipelineStage s) const {
+    return stages[static_cast<int>(s)];
+}
+
+int ThreadTopology::threadBudget(PipelineStage s) const {
+    const StageConfig& cfg = stage(s);
+    if (cfg.threads > 0) return cfg.threads;
+    return static_cast<int>(cfg.cpus.size());
+}
+
+bool ThreadTopology::applyToCurrentThread(PipelineStage s) const {
+    const StageConfig& cfg = stage(s);
+#ifdef __linux__
+    bool pinned = true;
+    if (!cfg.cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cfg.cpus) CPU_SET(cpu, &set);
+
+        int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (ret != 0) {
+            std::cerr << "[TOPOLOGY] Failed to pin " << stageName(s) << " thread to CPUs "
+                      << formatCpuList(cfg.cpus) << " (error " << ret << ")" << std::endl;
+            pinned = false;
+        }
+    }
+    std::cout << "[TOPOLOGY] " << stageName(s) << " thread affinity: "
+              << formatCpuList(currentAffinity());
+    if (!cfg.cpus.empty()) std::cout << " (requested " << formatCpuList(cfg.cpus) << ")";
+    std::cout << std::endl;
+    return pinned;
+#else
+    if (!cfg.cpus.empty()) {
+        std::cerr << "[TOPOLOGY] CPU pinning is not supported on this platform; "
+                  << stageName(s) << " thread left unpinned." << std::endl;
+    }
+    return cfg.cpus.empty();
+#endif
+}
+
+void ThreadTopology::logSummary() const {
+    for (int i = 0; i < static_cast<int>(PipelineStage::Count); ++i) {
+        PipelineStage s = static_cast<PipelineStage>(i);
+        const StageConfig& cfg = stages[i];
+        std::cout << "[TOPOLOGY] " << stageName(s) << ": cpus="
+                  << (cfg.cpus.empty() ? std::string("any") : formatCpuList(cfg.cpus));
+        if (s == PipelineStage::Decode || s == PipelineStage::Inference) {
+            int budget = threadBudget(s);
+            std::cout << ", threads=" << (budget > 0 ? std::to_string(budget) : std::string("default"));
+        } else {
+            std::cout << ", threads=1";
+        }
+        std::cout << std::endl;
+    }
+}
+
+bool ThreadTopology::parseCpuList(const std::string& text, std::vector<int>& cpus) {
+    cpus.clear();
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (item.empty()) continue;
+        size_t dash = item.find('-');
+        char* end = nullptr;
+        long first = std::strtol(item.c_str(), &end, 10);
+        long last = first;
+        if (dash != std::string::npos) {
+            if (end != item.c_str() + dash) return false;
+            last = std::strtol(item.c_str() + dash + 1, &end, 10);
+        }
+        if (*end != '\0' || first < 0 || last < first) return false;
+#ifdef __linux__
+        if (last >= CPU_SETSIZE) return false;
+#endif
+        for (long cpu = first; cpu <= last; ++cpu) cpus.push_back(static_cast<int>(cpu));
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return !cpus.empty();
+}
+
+std::string ThreadTopology::formatCpuList(const std::vector<int>& cpus) {
+    std::string out;
+    for (size_t i = 0; i < cpus.size(); ++i) {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) ++j;
+        if (!out.empty()) out += ",";
+        out += std::to_string(cpus[i]);
+        if (j > i) out += "-" + std::to_string(cpus[j]);
+        i = j;
+    }
+    return out.empty() ? "none" : out;
+}
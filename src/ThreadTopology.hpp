@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Pipeline stages that can be given their own CPU set and thread budget.
+enum class PipelineStage {
+    Ingest,
+    Decode,
+    Inference,
+    Mux,
+    DbWriter,
+    Count
+};
+
+struct StageConfig {
+    std::vector<int> cpus; // empty = inherit the process affinity
+    int threads = 0;       // 0 = one per CPU in the set, or the library default if no set
+};
+
+// Per-stage CPU pinning and thread budgets, configured through env vars:
+//   PIPELINE_CPUS_<STAGE>    CPU list, e.g. "0-1,4"
+//   PIPELINE_THREADS_<STAGE> worker count for stages with internal pools (DECODE, INFERENCE)
+// where <STAGE> is INGEST, DECODE, INFERENCE, MUX or DB_WRITER.
+class ThreadTopology {
+public:
+    ThreadTopology() = default;
+
+    void loadFromEnv();
+
+    const StageConfig& stage(PipelineStage s) const;
+
+    // Thread count to hand to OpenCV / libavcodec. 0 means "leave the library default".
+    int threadBudget(PipelineStage s) const;
+
+    // Pins the calling thread to the stage's CPU set and logs the affinity actually achieved.
+    // Threads spawned afterwards (e.g. codec or DNN pools) inherit the mask. Returns false
+    // if the requested CPU set could not be applied.
+    bool applyToCurrentThread(PipelineStage s) const;
+
+    void logSummary() const;
+
+    static const char* stageName(PipelineStage s);
+
+private:
+    StageConfig stages[static_cast<int>(PipelineStage::Count)];
+
+    static bool parseCpuList(const std::string& text, std::vector<int>& cpus);
+    static std::string formatCpuList(const std::vector<int>& cpus);
+};
@@ -1,9 +1,14 @@
 #include "YoloDetector.hpp"
 #include <fstream>
 #include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include "AllocationCounter.hpp"
 
 YoloDetector::YoloDetector() {
     loadClassNames();
+    label.reserve(64);
 }
 
 void YoloDetector::loadClassNames() {
@@ -26,6 +31,7 @@ bool YoloDetector::loadModel(const std::string& modelPath) {
         net = cv::dnn::readNetFromONNX(modelPath);
         net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
         net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU); // Or CUDA if available
+        outputNames = net.getUnconnectedOutLayersNames();
         std::cout << "Model loaded successfully: " << modelPath << std::endl;
         return true;
     } catch (const cv::Exception& e) {
@@ -34,62 +40,81 @@ bool YoloDetector::loadModel(const std::string& modelPath) {
     }
 }
 
+bool YoloDetector::warmUp() {
+    auto start = std::chrono::steady_clock::now();
+    try {
+        cv::Mat dummy = cv::Mat::zeros(static_cast<int>(INPUT_HEIGHT), static_cast<int>(INPUT_WIDTH), CV_8UC3);
+        detect(dummy);
+    } catch (const cv::Exception& e) {
+        std::cerr << "Model warm-up failed: " << e.what() << std::endl;
+        return false;
+    }
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Model warm-up took " << ms << " ms" << std::endl;
+    return true;
+}
+
 std::vector<Detection> YoloDetector::detect(const cv::Mat& frame, float confThreshold, float nmsThreshold) {
     std::vector<Detection> detections;
-    if (frame.empty()) return detections;
-
-    // Preprocess
-    cv::Mat blob;
-    cv::dnn::blobFromImage(frame, blob, 1.0 / 255.0, cv::Size(INPUT_WIDTH, INPUT_HEIGHT), cv::Scalar(), true, false);
-    net.setInput(blob);
+    detect(frame, frame.size(), detections, confThreshold, nmsThreshold);
+    return detections;
+}
 
-    // Inference
-    std::vector<cv::Mat> outputs;
-    net.forward(outputs, net.getUnconnectedOutLayersNames());
+void YoloDetector::detect(const cv::Mat& frame, cv::Size frameSize, std::vector<Detection>& detections,
+                          float confThreshold, float nmsThreshold) {
+    detections.clear();
+    if (frame.empty()) return;
+    if (detections.capacity() < MAX_DETECTIONS) detections.reserve(MAX_DETECTIONS);
+
+    // Preprocess (resize only if the caller has not already scaled to the model input)
+    const cv::Mat* input = &frame;
+    if (frame.size() != inputSize()) {
+        cv::resize(frame, resized, inputSize());
+        input = &resized;
+    }
+    fillBlob(*input);
+
+    // Inference. OpenCV DNN allocates internally on every pass, which we cannot pool; the
+    // allocation check reports these as exempt.
+    {
+        AllocationCounter::Exempt exempt;
+        net.setInput(blob);
+        net.forward(outputs, outputNames);
+    }
 
     // Post-processing (parsing YOLOv8 output)
-    // YOLOv8 output shape: [1, 84, 8400] -> [1, 4 + 80 classes, proposals]
-    
-    // We need to verify if the output is [1, 84, 8400] or something else depending on export
-    // Assuming standard export:
-    if (outputs.empty()) return detections;
-
-    cv::Mat output = outputs[0];
-    // Check dimensions. Usually 3D: [Batch, Channels, Anchors]
-    // We want to iterate over anchors.
-    
-    // If output is 3 dimensions:
-    int dimensions = output.dims;
-    int rows = output.size[1]; // 84 (4 box coords + 80 classes)
-    int cols = output.size[2]; // 8400 anchors
-
-    // Access data pointer
-    // Note: Some ONNX exports transpose this to [1, 8400, 84]. 
-    // Standard Ultralytics export is [1, 84, 8400].
-    
-    // For easier processing, let's transpose if needed so we have one row per detection
-    if (dimensions == 3 && output.size[1] < output.size[2]) {
-        // Current: [1, 84, 8400]. Reshape to remove batch dim, then transpose
-        output = output.reshape(1, rows); // [84, 8400]
-        cv::transpose(output, output);    // [8400, 84]
+    if (outputs.empty() || outputs[0].dims != 3) return;
+
+    // Standard Ultralytics export is [1, 84, 8400] -> [batch, 4 box coords + 80 classes, anchors].
+    // Some ONNX exports are already [1, 8400, 84].
+    const cv::Mat& output = outputs[0];
+    int anchors = output.size[1];
+    int stride = output.size[2];
+    const float* data = output.ptr<float>();
+
+    // We want one row per anchor
+    if (anchors < stride) {
+        cv::Mat view(anchors, stride, CV_32F, const_cast<float*>(data)); // header only, no copy
+        cv::transpose(view, transposed); // [8400, 84], buffer reused across frames
+        data = transposed.ptr<float>();
+        std::swap(anchors, stride);
+    }
+
+    classIds.clear();
+    confidences.clear();
+    boxes.clear();
+    if (boxes.capacity() < static_cast<size_t>(anchors)) {
+        classIds.reserve(anchors);
+        confidences.reserve(anchors);
+        boxes.reserve(anchors);
+        order.reserve(anchors);
     }
-    
-    rows = output.rows; 
-    
-    std::vector<int> classIds;
-    std::vector<float> confidences;
-    std::vector<cv::Rect> boxes;
-
-    float x_scale = frame.cols / INPUT_WIDTH;
-    float y_scale = frame.rows / INPUT_HEIGHT;
-
-    float* data = (float*)output.data;
-    
-    // Stride is 84 usually
-    int stride = output.cols; 
-
-    for (int i = 0; i < rows; ++i) {
-        float* rowPtr = data + i * stride;
+
+    float x_scale = frameSize.width / INPUT_WIDTH;
+    float y_scale = frameSize.height / INPUT_HEIGHT;
+
+    for (int i = 0; i < anchors; ++i) {
+        const float* rowPtr = data + i * stride;
         
         // Find max confidence in class scores (index 4 to 83)
         float maxClassScore = 0.0f;
@@ -120,27 +145,71 @@ std::vector<Detection> YoloDetector::detect(const cv::Mat& frame, float confThre
         }
     }
 
-    // NMS
-    std::vector<int> indices;
-    cv::dnn::NMSBoxes(boxes, confidences, confThreshold, nmsThreshold, indices);
+    nms(nmsThreshold);
 
     for (int idx : indices) {
-        Detection det;
-        det.class_id = classIds[idx];
-        det.confidence = confidences[idx];
-        det.box = boxes[idx];
-        det.className = (det.class_id >= 0 && det.class_id < classNames.size()) ? classNames[det.class_id] : "Unknown";
-        detections.push_back(det);
+        detections.push_back({classIds[idx], confidences[idx], boxes[idx]});
     }
+}
 
-    return detections;
+void YoloDetector::fillBlob(const cv::Mat& image) {
+    // Same as blobFromImage(image, 1/255, size, Scalar(), swapRB=true): BGR->RGB, scale to
+    // [0,1] and HWC->CHW in one pass, into a blob that is only allocated once.
+    CV_Assert(image.type() == CV_8UC3);
+    const int sz[] = {1, 3, image.rows, image.cols};
+    blob.create(4, sz, CV_32F);
+
+    const size_t area = static_cast<size_t>(image.rows) * image.cols;
+    float* r = blob.ptr<float>();
+    float* g = r + area;
+    float* b = g + area;
+    const float scale = 1.0f / 255.0f;
+    for (int y = 0; y < image.rows; ++y) {
+        const uchar* px = image.ptr<uchar>(y);
+        for (int x = 0; x < image.cols; ++x, px += 3) {
+            *b++ = px[0] * scale;
+            *g++ = px[1] * scale;
+            *r++ = px[2] * scale;
+        }
+    }
+}
+
+void YoloDetector::nms(float nmsThreshold) {
+    // Greedy class-agnostic NMS, as cv::dnn::NMSBoxes does, but on reused buffers
+    order.resize(boxes.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = static_cast<int>(i);
+    std::sort(order.begin(), order.end(), [this](int a, int b) { return confidences[a] > confidences[b]; });
+
+    indices.clear();
+    if (indices.capacity() < MAX_DETECTIONS) indices.reserve(MAX_DETECTIONS);
+    for (int i : order) {
+        if (indices.size() >= MAX_DETECTIONS) break;
+        bool keep = true;
+        for (int k : indices) {
+            float inter = static_cast<float>((boxes[i] & boxes[k]).area());
+            float uni = static_cast<float>(boxes[i].area() + boxes[k].area()) - inter;
+            if (uni > 0 && inter / uni > nmsThreshold) {
+                keep = false;
+                break;
+            }
+        }
+        if (keep) indices.push_back(i);
+    }
+}
+
+const std::string& YoloDetector::className(int classId) const {
+    static const std::string unknown = "Unknown";
+    return (classId >= 0 && classId < static_cast<int>(classNames.size())) ? classNames[classId] : unknown;
 }
 
 void YoloDetector::drawDetections(cv::Mat& frame, const std::vector<Detection>& detections) {
+    char text[64];
     for (const auto& det : detections) {
         cv::rectangle(frame, det.box, cv::Scalar(0, 255, 0), 2);
         
-        std::string label = det.className + ": " + cv::format("%.2f", det.confidence);
+        // Formatted into a reused string rather than a new one per box
+        snprintf(text, sizeof(text), "%s: %.2f", className(det.class_id).c_str(), det.confidence);
+        label.assign(text);
         int baseLine;
         cv::Size labelSize = cv::getTextSize(label, cv::FONT_HERSHEY_SIMPLEX, 0.5, 1, &baseLine);
         
@@ -5,11 +5,12 @@
 #include <vector>
 #include <string>
 
+// Plain data so result vectors can be reused frame to frame; resolve the name with
+// YoloDetector::className(class_id).
 struct Detection {
     int class_id;
     float confidence;
     cv::Rect box;
-    std::string className;
 };
 
 class YoloDetector {
@@ -18,18 +19,47 @@ public:
     ~YoloDetector() = default;
 
     bool loadModel(const std::string& modelPath);
+    // Runs one inference on a blank frame so the first real frame does not pay for
+    // backend initialization and buffer allocation.
+    bool warmUp();
     std::vector<Detection> detect(const cv::Mat& frame, float confThreshold = 0.4f, float nmsThreshold = 0.4f);
 
+    // Steady-state variant: reuses the detector's buffers and fills `detections` in place, so
+    // nothing is allocated once buffers have grown to size. `frame` may already be scaled to
+    // inputSize() (then it is not resized again); boxes are reported in `frameSize` coordinates.
+    void detect(const cv::Mat& frame, cv::Size frameSize, std::vector<Detection>& detections,
+                float confThreshold = 0.4f, float nmsThreshold = 0.4f);
+
+    cv::Size inputSize() const { return cv::Size(static_cast<int>(INPUT_WIDTH), static_cast<int>(INPUT_HEIGHT)); }
+    const std::string& className(int classId) const;
+
     // Helper to draw bounding boxes
     void drawDetections(cv::Mat& frame, const std::vector<Detection>& detections);
 
 private:
     cv::dnn::Net net;
     std::vector<std::string> classNames;
+    std::vector<cv::String> outputNames;
     
     // Model input parameters (YOLOv8 default)
     const float INPUT_WIDTH = 640.0;
     const float INPUT_HEIGHT = 640.0;
+    // Same cap as Ultralytics' max_det; lets the result vector be sized once
+    static const size_t MAX_DETECTIONS = 300;
+
+    // Per-frame buffers, reused across calls
+    cv::Mat resized;
+    cv::Mat blob;
+    std::vector<cv::Mat> outputs;
+    cv::Mat transposed;
+    std::vector<int> classIds;
+    std::vector<float> confidences;
+    std::vector<cv::Rect> boxes;
+    std::vector<int> order;
+    std::vector<int> indices;
+    std::string label;
     
     void loadClassNames();
+    void fillBlob(const cv::Mat& image);
+    void nms(float nmsThreshold);
 };
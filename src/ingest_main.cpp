@@ -0,0 +1,99 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <filesystem>
+#include <system_error>
+
+#include "IngestEngine.hpp"
+#include "ThreadTopology.hpp"
+#include "EnvConfig.hpp"
+
+// Remux-only ingest node: many RTSP (H.264) streams to per-stream HLS, on a fixed thread pool.
+// The stream list has one "<name> <rtsp_url>" (or just "<rtsp_url>") per line; '#' starts a comment.
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cout << "Usage: " << argv[0] << " <stream_list> [output_dir]" << std::endl;
+        return 1;
+    }
+
+    std::string listPath = argv[1];
+    std::string outputDir = argc > 2 ? argv[2] : "hls_output";
+
+    ThreadTopology topology;
+    topology.loadFromEnv();
+    topology.logSummary();
+
+    IngestConfig config;
+    config.ioThreads = static_cast<int>(envInt("INGEST_IO_THREADS", 4, 1));
+    config.muxThreads = static_cast<int>(envInt("INGEST_MUX_THREADS", 2, 1));
+    config.muxQueuePackets = static_cast<size_t>(envInt("INGEST_MUX_QUEUE", 1024, 1));
+    config.connectTimeoutMs = envInt("INGEST_CONNECT_TIMEOUT_MS", 10000, 1);
+    config.streamTimeoutMs = envInt("INGEST_STREAM_TIMEOUT_MS", 5000, 1);
+    config.maxBackoffMs = envInt("INGEST_MAX_BACKOFF_MS", 30000, 1000);
+    int statsSec = static_cast<int>(envInt("INGEST_STATS_SEC", 10, 0));
+
+    IngestEngine engine(config);
+    engine.setThreadTopology(&topology);
+
+    std::ifstream list(listPath);
+    if (!list) {
+        std::cerr << "Could not open stream list: " << listPath << std::endl;
+        return 1;
+    }
+
+    int count = 0;
+    std::string line;
+    while (std::getline(list, line)) {
+        std::istringstream fields(line);
+        std::string first, second;
+        if (!(fields >> first) || first[0] == '#') continue;
+
+        std::string name = "stream" + std::to_string(count);
+        std::string url = first;
+        if (fields >> second) {
+            name = first;
+            url = second;
+        }
+
+        std::string streamDir = outputDir + "/" + name;
+        std::error_code ec;
+        std::filesystem::create_directories(streamDir, ec);
+        if (ec) {
+            std::cerr << "Skipping " << name << ": could not create " << streamDir << ": " << ec.message() << std::endl;
+            continue;
+        }
+        engine.addStream(name, url, streamDir + "/stream.m3u8");
+        count++;
+    }
+
+    if (count == 0) {
+        std::cerr << "No usable streams in " << listPath << std::endl;
+        return 1;
+    }
+
+    engine.start();
+
+    std::atomic<bool> running(true);
+    std::thread statsThread([&]() {
+        int elapsed = 0;
+        while (running) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            if (statsSec > 0 && ++elapsed % statsSec == 0) {
+                engine.logStats();
+            }
+        }
+    });
+
+    std::cout << "Ingesting " << count << " streams. Press Enter to stop." << std::endl;
+    std::cin.get();
+
+    running = false;
+    statsThread.join();
+    engine.stop();
+    engine.logStats();
+    return 0;
+}
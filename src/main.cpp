@@ -4,11 +4,24 @@
 #include <chrono>
 #include <iomanip>
 #include <sstream>
+#include <cmath>
+#include <cstdlib>
+#include <future>
+#include <mutex>
+#include <condition_variable>
 
 #include "RTSPStreamer.hpp"
 #include "HLSRecorder.hpp"
+#include "ClipRecorder.hpp"
 #include "YoloDetector.hpp"
 #include "SafeQueue.hpp"
+#include "PacketQueue.hpp"
+#include "PacketPool.hpp"
+#include "FrameQueue.hpp"
+#include "MemoryBudget.hpp"
+#include "ThreadTopology.hpp"
+#include "AllocationCounter.hpp"
+#include "EnvConfig.hpp"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -18,17 +31,39 @@ extern "C" {
 
 #include "DatabaseHandler.hpp"
 
-// Global queues
-SafeQueue<AVPacket*> hlsQueue;
-SafeQueue<AVPacket*> detectQueue;
+// A detection waiting to be written by the DB writer thread
+struct DetectionRecord {
+    std::string deviceName;
+    std::string className;
+    float confidence;
+    std::string timestamp;
+    std::string framePath;
+    double streamTime; // estimated seconds on the main stream timeline, NaN if unknown
+    std::string clipPath;
+};
+
+// Global queues (packet queues are created in main once the memory budget is configured)
+SafeQueue<DetectionRecord> dbQueue;
+size_t dbQueueMax = 1000; // records; a slow or unreachable DB drops new records beyond this
+
+// Process start, for startup timing and time-to-first-detection
+const std::chrono::steady_clock::time_point pipelineStart = std::chrono::steady_clock::now();
+
+static long long msSinceStart() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - pipelineStart).count();
+}
+
+void hlsWorker(PacketQueue* hlsQueue, HLSRecorder* recorder, ClipRecorder* clipRecorder, const ThreadTopology* topology) {
+    topology->applyToCurrentThread(PipelineStage::Mux);
 
-void hlsWorker(HLSRecorder* recorder) {
     AVPacket* pkt = nullptr;
     while (true) {
-        if (hlsQueue.pop(pkt)) {
+        if (hlsQueue->pop(pkt)) {
             if (pkt) {
+                // Clip ring first: the HLS muxer rescales the packet in place
+                if (clipRecorder) clipRecorder->pushPacket(pkt);
                 recorder->writePacket(pkt);
-                av_packet_free(&pkt);
+                hlsQueue->pool().release(pkt);
             }
         } else {
             // Queue stopped and empty
@@ -37,161 +72,375 @@ void hlsWorker(HLSRecorder* recorder) {
     }
 }
 
-// Decode and Detect Worker
-// We need to implement decoding here since we receive packets
-void detectorWorker(YoloDetector* detector, AVCodecParameters* codecParams, DatabaseHandler* dbHandler) {
+// Decode Worker
+// Runs on the decode CPU set for its whole life, so decoding stays there even when
+// libavcodec runs it on the calling thread (thread_count 1).
+void decodeWorker(PacketQueue* detectQueue, RTSPStreamer* source, FrameQueue* frameQueue, const ThreadTopology* topology) {
+    topology->applyToCurrentThread(PipelineStage::Decode);
+
+    AVCodecParameters* codecParams = source->getCodecParameters();
     const AVCodec* codec = avcodec_find_decoder(codecParams->codec_id);
     if (!codec) {
         std::cerr << "Codec not found for detection worker." << std::endl;
+        frameQueue->stop();
         return;
     }
 
     AVCodecContext* codecCtx = avcodec_alloc_context3(codec);
     avcodec_parameters_to_context(codecCtx, codecParams);
-    
+    codecCtx->pkt_timebase = source->getTimeBase();
+    // Only override when configured: 0 would let libavcodec size its pool to all cores,
+    // while the context default is a single thread
+    int decodeThreads = topology->threadBudget(PipelineStage::Decode);
+    if (decodeThreads > 0) {
+        codecCtx->thread_count = decodeThreads;
+    }
+
+    // Codec worker threads are spawned inside avcodec_open2 and inherit the decode CPU set
     if (avcodec_open2(codecCtx, codec, nullptr) < 0) {
         std::cerr << "Could not open codec for detection worker." << std::endl;
+        avcodec_free_context(&codecCtx);
+        frameQueue->stop();
         return;
     }
+    std::cout << "[TOPOLOGY] decode threads: " << codecCtx->thread_count << std::endl;
 
     AVFrame* frame = av_frame_alloc();
     AVPacket* pkt = nullptr;
+    // With ENABLE_ALLOC_COUNTER, every packet after the warm-up must not allocate
+    AllocationCounter::Loop allocCheck("decode");
+    while (detectQueue->pop(pkt)) {
+        if (!pkt) continue;
+        allocCheck.begin();
+        int ret;
+        {
+            // libavcodec's internals (packet and frame references, threading)
+            AllocationCounter::Exempt exempt;
+            ret = avcodec_send_packet(codecCtx, pkt);
+        }
+        while (ret >= 0) {
+            {
+                AllocationCounter::Exempt exempt;
+                ret = avcodec_receive_frame(codecCtx, frame);
+            }
+            if (ret < 0) break; // EAGAIN/EOF, or a decode error
+            // Hands over the picture; if inference is behind, the oldest waiting frame is dropped
+            frameQueue->push(frame);
+        }
+        detectQueue->pool().release(pkt);
+        allocCheck.end();
+    }
+
+    frameQueue->stop();
+    av_frame_free(&frame);
+    avcodec_free_context(&codecCtx);
+}
+
+// Detect Worker
+// `source` is the stream being decoded (main stream or substream); `timeline` is the main
+// stream's clock, used to estimate each detection's position on the main stream.
+void detectorWorker(FrameQueue* frameQueue, YoloDetector* detector, RTSPStreamer* source, const StreamClock* timeline,
+                    ClipRecorder* clipRecorder, const std::string& deviceName, const ThreadTopology* topology) {
+    // OpenCV's pool is created on first use and inherits this mask
+    topology->applyToCurrentThread(PipelineStage::Inference);
+
+    // Everything the frame path touches is allocated once and reused: the frames (pooled by
+    // the frame queue), the detector-input image, the full-res image for saved frames and
+    // the result vector.
+    AVFrame* frame = nullptr;
+    cv::Mat input; // scaled straight to the model input size by swscale
+    cv::Mat img;   // full resolution, only converted for frames that get saved
+    std::vector<Detection> detections;
+
+    // DB hand-off overflow state (only this thread pushes records)
+    bool dbDropping = false;
+    uint64_t dbDropped = 0;
     
     // For swscale context
-    struct SwsContext* sws_ctx = nullptr;
+    struct SwsContext* sws_ctx = nullptr;      // decoded frame -> model input
+    struct SwsContext* sws_full_ctx = nullptr; // decoded frame -> full-res BGR
+    bool firstFrame = true;
+
+    // With ENABLE_ALLOC_COUNTER, every frame after the warm-up must not allocate
+    AllocationCounter::Loop allocCheck("inference");
     
     while (true) {
-        if (detectQueue.pop(pkt)) {
-            if (pkt) {
-                int ret = avcodec_send_packet(codecCtx, pkt);
-                if (ret >= 0) {
-                    while (ret >= 0) {
-                        ret = avcodec_receive_frame(codecCtx, frame);
-                        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
-                            break;
-                        else if (ret < 0) {
-                             // error
-                             break;
-                        }
-
-                        // Convert AVFrame (YUV420P usually) to cv::Mat (BGR)
-                        if (!sws_ctx) {
-                            sws_ctx = sws_getContext(frame->width, frame->height, codecCtx->pix_fmt,
-                                                     frame->width, frame->height, AV_PIX_FMT_BGR24,
-                                                     SWS_BILINEAR, nullptr, nullptr, nullptr);
-                        }
-
-                        cv::Mat img(frame->height, frame->width, CV_8UC3);
-                        uint8_t* dest[4] = { img.data, 0, 0, 0 };
-                        int destLinesize[4] = { (int)img.step[0], 0, 0, 0 };
-
-                        sws_scale(sws_ctx, frame->data, frame->linesize, 0, frame->height, dest, destLinesize);
-
-                        // Run Detection
-                        auto detections = detector->detect(img);
-                        detector->drawDetections(img, detections);
-
-                        if (!detections.empty()) {
-                             std::cout << "Detected " << detections.size() << " objects." << std::endl;
-                             
-                             // Save frame
-                             auto now = std::chrono::system_clock::now();
-                             auto time = std::chrono::system_clock::to_time_t(now);
-                             auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()) % 1000;
-                             
-                             std::stringstream ss;
-                             ss << std::put_time(std::localtime(&time), "%Y%m%d_%H%M%S") 
-                                << "_" << ms.count();
-                             
-                             std::string timestamp = ss.str();
-                             // ISO format sort of
-                             
-                             std::string filename = "detected_frames/frame_" + timestamp + ".jpg";
-                             
-                             cv::imwrite(filename, img);
-
-                             // Log to Database
-                             for (const auto& det : detections) {
-                                  dbHandler->logDetection("cam1", det.className, det.confidence, timestamp, filename);
-                             }
-                        }
-
-                    }
-                }
-                av_packet_free(&pkt);
-            }
-        } else {
+        allocCheck.begin();
+        if (!frameQueue->pop(frame)) {
             break;
         }
+        AVPixelFormat pixFmt = static_cast<AVPixelFormat>(frame->format);
+
+        // Convert AVFrame (YUV420P usually) to cv::Mat (BGR), resizing to the model
+        // input in the same pass
+        cv::Size inputSize = detector->inputSize();
+        if (!sws_ctx) {
+            sws_ctx = sws_getContext(frame->width, frame->height, pixFmt,
+                                     inputSize.width, inputSize.height, AV_PIX_FMT_BGR24,
+                                     SWS_BILINEAR, nullptr, nullptr, nullptr);
+        }
+
+        input.create(inputSize.height, inputSize.width, CV_8UC3); // no-op after the first frame
+        uint8_t* dest[4] = { input.data, 0, 0, 0 };
+        int destLinesize[4] = { (int)input.step[0], 0, 0, 0 };
+
+        sws_scale(sws_ctx, frame->data, frame->linesize, 0, frame->height, dest, destLinesize);
+
+        // Run Detection
+        detector->detect(input, cv::Size(frame->width, frame->height), detections);
+
+        allocCheck.end();
+
+        if (firstFrame) {
+            firstFrame = false;
+            std::cout << "[STARTUP] Time to first detection: " << msSinceStart() << " ms" << std::endl;
+        }
+
+        if (!detections.empty()) {
+             // Saving an event allocates (paths, JPEG encoding, DB records); only
+             // the frame path above is held to zero allocations
+             std::cout << "Detected " << detections.size() << " objects." << std::endl;
+
+             // Full-res frame with boxes, only for frames that are saved
+             if (!sws_full_ctx) {
+                 sws_full_ctx = sws_getContext(frame->width, frame->height, pixFmt,
+                                               frame->width, frame->height, AV_PIX_FMT_BGR24,
+                                               SWS_BILINEAR, nullptr, nullptr, nullptr);
+             }
+             img.create(frame->height, frame->width, CV_8UC3);
+             uint8_t* fullDest[4] = { img.data, 0, 0, 0 };
+             int fullLinesize[4] = { (int)img.step[0], 0, 0, 0 };
+             sws_scale(sws_full_ctx, frame->data, frame->linesize, 0, frame->height, fullDest, fullLinesize);
+             detector->drawDetections(img, detections);
+
+             // Estimated position on the main stream (HLS) timeline, see StreamClock. Stays
+             // NULL until both clocks have an estimate, instead of a guess from the first packets.
+             const StreamClock& clock = source->getClock();
+             double streamTime = NAN;
+             if (&clock == timeline || (clock.hasEstimate() && timeline->hasEstimate())) {
+                 int64_t mainPts = clock.convertTo(frame->best_effort_timestamp, *timeline);
+                 if (mainPts != AV_NOPTS_VALUE) streamTime = mainPts * av_q2d(timeline->getTimeBase());
+             }
+             
+             // Save frame
+             auto now = std::chrono::system_clock::now();
+             auto time = std::chrono::system_clock::to_time_t(now);
+             auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()) % 1000;
+             
+             std::stringstream ss;
+             ss << std::put_time(std::localtime(&time), "%Y%m%d_%H%M%S") 
+                << "_" << ms.count();
+             
+             std::string timestamp = ss.str();
+             // ISO format sort of
+             
+             std::string filename = "detected_frames/frame_" + timestamp + ".jpg";
+             
+             cv::imwrite(filename, img);
+
+             // Pre-roll + post-roll clip from the main stream; written in the background
+             std::string clipPath = clipRecorder ? clipRecorder->trigger(timestamp) : "";
+
+             // Hand off to the DB writer; if it has fallen behind, newer records are dropped
+             for (const auto& det : detections) {
+                  DetectionRecord rec{deviceName, detector->className(det.class_id), det.confidence, timestamp, filename, streamTime, clipPath};
+                  if (!dbQueue.tryPush(std::move(rec), dbQueueMax)) {
+                      dbDropped++;
+                      if (!dbDropping) {
+                          dbDropping = true;
+                          std::cerr << "[DB] write queue full (" << dbQueueMax << " records), dropping detections" << std::endl;
+                      }
+                  } else if (dbDropping) {
+                      dbDropping = false;
+                      std::cerr << "[DB] write queue recovered, " << dbDropped << " detections dropped so far" << std::endl;
+                  }
+             }
+        }
+
+        frameQueue->release(frame);
     }
 
     if (sws_ctx) sws_freeContext(sws_ctx);
-    av_frame_free(&frame);
-    avcodec_free_context(&codecCtx);
+    if (sws_full_ctx) sws_freeContext(sws_full_ctx);
+}
+
+void dbWorker(DatabaseHandler* dbHandler, const ThreadTopology* topology) {
+    topology->applyToCurrentThread(PipelineStage::DbWriter);
+
+    DetectionRecord rec;
+    while (dbQueue.pop(rec)) {
+        dbHandler->logDetection(rec.deviceName, rec.className, rec.confidence, rec.timestamp, rec.framePath, rec.streamTime, rec.clipPath);
+    }
 }
 
 int main(int argc, char* argv[]) {
     if (argc < 3) {
-        std::cout << "Usage: " << argv[0] << " <rtsp_url> <model_path>" << std::endl;
+        std::cout << "Usage: " << argv[0] << " <rtsp_url> <model_path> [detect_rtsp_url]" << std::endl;
         return 1;
     }
 
     // Create output directories
     const std::string frameDir = "detected_frames";
     const std::string hlsDir = "hls_output";
-    std::string cmd = "mkdir -p " + frameDir + " " + hlsDir;
+    const std::string clipDir = "clips";
+    std::string cmd = "mkdir -p " + frameDir + " " + hlsDir + " " + clipDir;
     system(cmd.c_str());
 
     std::string rtspUrl = argv[1];
     std::string modelPath = argv[2];
 
+    // Thread topology: per-stage CPU sets and thread budgets
+    ThreadTopology topology;
+    topology.loadFromEnv();
+    topology.logSummary();
+
+    int inferenceThreads = topology.threadBudget(PipelineStage::Inference);
+    if (inferenceThreads > 0) {
+        cv::setNumThreads(inferenceThreads);
+    }
+    std::cout << "[TOPOLOGY] OpenCV threads: " << cv::getNumThreads() << std::endl;
+
     // Initialize Components
     RTSPStreamer streamer;
+    RTSPStreamer detectStreamer; // low-res substream, only opened in dual-stream mode
     YoloDetector detector;
     HLSRecorder recorder;
     // DB Setup
     DatabaseHandler dbHandler; 
     
-    auto getEnvVar = [](const std::string& key, const std::string& defaultValue) -> std::string {
-        const char* val = std::getenv(key.c_str());
-        return val ? std::string(val) : defaultValue;
-    };
-
     // Connection string from Env Vars or defaults
-    std::string dbHost = getEnvVar("DB_HOST", "localhost");
-    std::string dbPort = getEnvVar("DB_PORT", "5432");
-    std::string dbUser = getEnvVar("POSTGRES_USER", "admin");
-    std::string dbPass = getEnvVar("POSTGRES_PASSWORD", "password");
-    std::string dbName = getEnvVar("POSTGRES_DB", "analytics_db");
-
-    std::string dbConn = "postgresql://" + dbUser + ":" + dbPass + "@" + dbHost + ":" + dbPort + "/" + dbName;
-    
-    bool dbConnected = false;
-    const int maxRetries = 5;
-    for (int i = 0; i < maxRetries; ++i) {
-        if (dbHandler.init(dbConn)) {
-            dbConnected = true;
-            break;
-        }
-        std::cerr << "Warning: Could not connect to PostgreSQL database. Retrying " << (i + 1) << "/" << maxRetries << "..." << std::endl;
-        std::this_thread::sleep_for(std::chrono::seconds(2));
-    }
-
-    if (!dbConnected) {
-        std::cerr << "[ERROR] Failed to connect to database after " << maxRetries << " attempts. Exiting." << std::endl;
+    std::string dbHost = envString("DB_HOST", "localhost");
+    std::string dbPort = envString("DB_PORT", "5432");
+    std::string dbUser = envString("POSTGRES_USER", "admin");
+    std::string dbPass = envString("POSTGRES_PASSWORD", "password");
+    std::string dbName = envString("POSTGRES_DB", "analytics_db");
+
+    std::string cameraName = envString("CAMERA_NAME", "cam1");
+    dbQueueMax = static_cast<size_t>(envInt("DB_QUEUE_MAX", 1000, 1));
+
+    // Optional substream for detection, so the detector never decodes the full-res main stream
+    std::string detectUrl = argc > 3 ? argv[3] : envString("DETECT_RTSP_URL", "");
+    bool dualStream = !detectUrl.empty() && detectUrl != rtspUrl;
+
+    // connect_timeout bounds each attempt, so cancelling the retry loop takes at most that long
+    std::string dbConn = "postgresql://" + dbUser + ":" + dbPass + "@" + dbHost + ":" + dbPort + "/" + dbName
+                         + "?connect_timeout=5";
+
+    // Probe limits for stream open; FFmpeg's defaults (5 MB / 5 s) dominate RTSP startup.
+    // The byte cap stays above one 4K keyframe, and open() re-probes if it still misses the frame size.
+    int64_t probeSize = envInt("RTSP_PROBESIZE", 4000000, 32);
+    int64_t analyzeDurationUs = envInt("RTSP_ANALYZEDURATION_MS", 1000, 0) * 1000;
+    streamer.setProbeLimits(probeSize, analyzeDurationUs);
+    detectStreamer.setProbeLimits(probeSize, analyzeDurationUs);
+    streamer.setThreadTopology(&topology);
+    detectStreamer.setThreadTopology(&topology);
+
+    // Memory budget shared by all packet queues. Packets are charged by payload size,
+    // so a burst of 4K keyframes hits the limit long before a packet count would.
+    // Created before startup so each stream can be read as soon as it is open.
+    size_t globalBudgetMb = static_cast<size_t>(envInt("MEMORY_BUDGET_MB", 512, 1));
+    size_t cameraBudgetMb = static_cast<size_t>(envInt("CAMERA_MEMORY_BUDGET_MB", 256, 1));
+    OverflowPolicy hlsPolicy = OverflowPolicy::DropNonKeyframe;
+    OverflowPolicy detectPolicy = OverflowPolicy::DropNonKeyframe;
+    if (!parseOverflowPolicy(envString("HLS_QUEUE_POLICY", "drop-non-keyframe"), hlsPolicy) ||
+        !parseOverflowPolicy(envString("DETECT_QUEUE_POLICY", "drop-non-keyframe"), detectPolicy)) {
+        std::cerr << "Invalid queue policy (expected drop-oldest, drop-non-keyframe or block)." << std::endl;
         return 1;
     }
-    std::cout << "[DEBUG] Database initialized." << std::endl;
 
-    if (!detector.loadModel(modelPath)) {
-        std::cerr << "Failed to load model." << std::endl;
-        return 1;
-    }
+    MemoryBudget memoryBudget(globalBudgetMb * 1024 * 1024);
+    MemoryBudget::Account* cameraAccount = memoryBudget.addAccount(cameraName, cameraBudgetMb * 1024 * 1024);
+    // Packet structs are recycled between the ingest thread and both workers
+    PacketPool packetPool;
+    PacketQueue hlsQueue("hls", memoryBudget, cameraAccount, packetPool, hlsPolicy);
+    // Detection also keeps a short packet cap so it stays close to live
+    PacketQueue detectQueue("detect", memoryBudget, cameraAccount, packetPool, detectPolicy, 30);
+    std::cout << "[MEMORY] budget: " << globalBudgetMb << " MB global, " << cameraBudgetMb << " MB for " << cameraName
+              << "; hls=" << overflowPolicyName(hlsPolicy) << ", detect=" << overflowPolicyName(detectPolicy) << std::endl;
+
+    // Event clips: in-memory pre-roll of the main stream, remuxed to MP4 on detection.
+    // Declared after the budget it charges, so it is destroyed first.
+    ClipRecorder clipRecorder;
+    // Decoded frames are handed to inference through a two-frame queue, charged to the
+    // camera's budget by picture size under the detection policy
+    FrameQueue frameQueue("frames", memoryBudget, cameraAccount, detectPolicy, 2);
+    std::thread hlsThread, decodeThread, detThread, dbThread;
+
+    // Cold start: DB connect, model load + warm-up and stream opens don't depend on each
+    // other, so run them concurrently. Startup takes as long as the slowest, not the sum.
+    const int maxRetries = 5;
+    // Set when startup fails elsewhere, so the DB retry loop stops instead of holding up exit
+    std::mutex startupMtx;
+    std::condition_variable startupCv;
+    bool startupCancelled = false;
+    auto dbReady = std::async(std::launch::async, [&]() {
+        for (int i = 0; i < maxRetries; ++i) {
+            if (dbHandler.init(dbConn)) {
+                std::cout << "[STARTUP] Database ready at " << msSinceStart() << " ms" << std::endl;
+                return true;
+            }
+            std::cerr << "Warning: Could not connect to PostgreSQL database. Retrying " << (i + 1) << "/" << maxRetries << "..." << std::endl;
+            std::unique_lock<std::mutex> lock(startupMtx);
+            if (startupCv.wait_for(lock, std::chrono::seconds(2), [&] { return startupCancelled; })) break;
+        }
+        return false;
+    });
+
+    auto modelReady = std::async(std::launch::async, [&]() {
+        // OpenCV's pool is spawned by the warm-up, so give it the inference CPU set
+        topology.applyToCurrentThread(PipelineStage::Inference);
+        if (!detector.loadModel(modelPath) || !detector.warmUp()) {
+            return false;
+        }
+        std::cout << "[STARTUP] Model ready at " << msSinceStart() << " ms" << std::endl;
+        return true;
+    });
+
+    // The substream is read as soon as it is open, so the camera never sees an idle session
+    // while the rest of startup finishes; the detect queue's packet cap keeps only the newest.
+    auto detectStreamReady = std::async(std::launch::async, [&]() {
+        if (!dualStream) return true;
+        if (!detectStreamer.open(detectUrl)) return false;
+        detectStreamer.start(detectQueue);
+        return true;
+    });
+
+    // Stops whatever has been started. Queues first, so an ingest thread blocked on the
+    // memory budget can return.
+    auto stopPipeline = [&]() {
+        {
+            std::lock_guard<std::mutex> lock(startupMtx);
+            startupCancelled = true;
+        }
+        startupCv.notify_all();
+        // Startup tasks still running are waited for here rather than in their future's
+        // destructor: the DB task returns after its current attempt, the model load and
+        // substream open run to completion
+        if (dbReady.valid()) dbReady.wait();
+        if (modelReady.valid()) modelReady.wait();
+        if (detectStreamReady.valid()) detectStreamReady.wait(); // may still start the substream
+        hlsQueue.stop();
+        detectQueue.stop();
+        streamer.stop();
+        detectStreamer.stop();
+
+        if (hlsThread.joinable()) hlsThread.join();
+        if (decodeThread.joinable()) decodeThread.join(); // stops the frame queue on exit
+        frameQueue.stop();
+        if (detThread.joinable()) detThread.join();
+        clipRecorder.finish();
+
+        // Detector is done producing; let the DB writer drain what is left
+        dbQueue.stop();
+        if (dbThread.joinable()) dbThread.join();
+    };
 
     if (!streamer.open(rtspUrl)) {
         std::cerr << "Failed to open RTSP stream." << std::endl;
+        stopPipeline();
         return 1;
     }
+    std::cout << "[STARTUP] Main stream open at " << msSinceStart() << " ms" << std::endl;
     
     // Calculate output path
     std::string hlsOutput = "hls_output/stream.m3u8";
@@ -206,27 +455,69 @@ int main(int argc, char* argv[]) {
 
     if (!recorder.init(hlsOutput, codecParams, tb)) {
         std::cerr << "HLSRecorder init failed." << std::endl;
+        stopPipeline();
         return 1;
     }
     std::cout << "[DEBUG] HLSRecorder initialized." << std::endl;
 
-    // Start threads
-    std::cout << "Starting pipeline..." << std::endl;
-    streamer.start(hlsQueue, detectQueue);
+    bool clipsEnabled = envString("CLIP_RECORDING", "1") != "0";
+    if (clipsEnabled) {
+        double preRollSec = envDouble("CLIP_PREROLL_SEC", 5, 0);
+        double postRollSec = envDouble("CLIP_POSTROLL_SEC", 5, 0);
+        size_t clipBufferMb = static_cast<size_t>(envInt("CLIP_BUFFER_MB", 64, 1));
+        clipRecorder.setThreadTopology(&topology);
+        if (!clipRecorder.init(clipDir, cameraName, codecParams, tb, preRollSec, postRollSec, clipBufferMb * 1024 * 1024,
+                               memoryBudget, cameraAccount)) {
+            std::cerr << "ClipRecorder init failed, continuing without event clips." << std::endl;
+            clipsEnabled = false;
+        }
+    }
+    ClipRecorder* clips = clipsEnabled ? &clipRecorder : nullptr;
+
+    // HLS only needs the main stream: start ingest and muxing now rather than after the
+    // model and database are ready
+    if (dualStream) {
+        // Main stream is remux-only; the substream feeds the detector
+        streamer.start(hlsQueue);
+    } else {
+        streamer.start(hlsQueue, detectQueue);
+    }
+    hlsThread = std::thread(hlsWorker, &hlsQueue, &recorder, clips, &topology);
+    std::cout << "[STARTUP] HLS ingest started at " << msSinceStart() << " ms" << std::endl;
 
-    std::thread hlsThread(hlsWorker, &recorder);
-    std::thread detThread(detectorWorker, &detector, streamer.getCodecParameters(), &dbHandler);
+    if (!detectStreamReady.get()) {
+        std::cerr << "Failed to open detection RTSP stream." << std::endl;
+        stopPipeline();
+        return 1;
+    }
+    RTSPStreamer* detectSource = dualStream ? &detectStreamer : &streamer;
+    if (dualStream) {
+        std::cout << "Dual-stream mode: HLS from " << rtspUrl << ", detection from " << detectUrl << std::endl;
+    }
+    decodeThread = std::thread(decodeWorker, &detectQueue, detectSource, &frameQueue, &topology);
+
+    if (!modelReady.get()) {
+        std::cerr << "Failed to load model." << std::endl;
+        stopPipeline();
+        return 1;
+    }
+
+    if (!dbReady.get()) {
+        std::cerr << "[ERROR] Failed to connect to database after " << maxRetries << " attempts. Exiting." << std::endl;
+        stopPipeline();
+        return 1;
+    }
+    std::cout << "[DEBUG] Database initialized." << std::endl;
+
+    // Start threads
+    std::cout << "Starting pipeline... (startup took " << msSinceStart() << " ms)" << std::endl;
+    detThread = std::thread(detectorWorker, &frameQueue, &detector, detectSource, &streamer.getClock(), clips, cameraName, &topology);
+    dbThread = std::thread(dbWorker, &dbHandler, &topology);
 
     std::cout << "Press Enter to stop..." << std::endl;
     std::cin.get();
 
-    // Stop
-    streamer.stop();
-    hlsQueue.stop();
-    detectQueue.stop();
-
-    if (hlsThread.joinable()) hlsThread.join();
-    if (detThread.joinable()) detThread.join();
+    stopPipeline();
 
     return 0;
 }
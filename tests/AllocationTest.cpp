@@ -0,0 +1,199 @@
+// Steady-state allocation check for the hand-offs between the ingest, decode and inference
+// threads: PacketPool, PacketQueue, FrameQueue and MemoryBudget, wired as in main.cpp.
+// Built with the allocation counter; the FFmpeg calls that allocate by design stand in for
+// the demuxer and decoder and are Exempt, as in the pipeline.
+#include "AllocationCounter.hpp"
+#include "MemoryBudget.hpp"
+#include "PacketPool.hpp"
+#include "PacketQueue.hpp"
+#include "FrameQueue.hpp"
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <thread>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/mem.h>
+}
+
+static int failures = 0;
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+static const int PACKETS = 3000;
+static const int GOP = 30;
+static const int PACKET_SIZE = 4000;
+
+struct LoopResult {
+    uint64_t steady = 0;
+    uint64_t failed = 0;
+};
+
+static void counterSeesAllAllocations() {
+    // C allocations inside FFmpeg are counted, not only operator new
+    uint64_t before = AllocationCounter::count();
+    void* p = av_malloc(64);
+    CHECK(AllocationCounter::count() > before);
+    av_free(p);
+
+    before = AllocationCounter::count();
+    int* q = new int[16];
+    CHECK(AllocationCounter::count() > before);
+    delete[] q;
+
+    // Exempt allocations are counted separately
+    before = AllocationCounter::count();
+    uint64_t exemptBefore = AllocationCounter::exemptCount();
+    {
+        AllocationCounter::Exempt exempt;
+        p = av_malloc(64);
+    }
+    av_free(p);
+    CHECK(AllocationCounter::count() == before);
+    CHECK(AllocationCounter::exemptCount() > exemptBefore);
+}
+
+// RTSPStreamer::recordLoop with a stand-in demuxer
+static void ingest(PacketQueue* hlsQueue, PacketQueue* detectQueue, LoopResult* result) {
+    PacketQueue* sinks[2] = {hlsQueue, detectQueue};
+    AVPacket* packet = av_packet_alloc();
+    AllocationCounter::Loop allocCheck("ingest");
+    for (int i = 0; i < PACKETS; i++) {
+        allocCheck.begin();
+        {
+            AllocationCounter::Exempt exempt;
+            av_new_packet(packet, PACKET_SIZE);
+        }
+        std::memset(packet->data, i & 0xff, PACKET_SIZE);
+        packet->pts = packet->dts = i * 3000;
+        if (i % GOP == 0) packet->flags |= AV_PKT_FLAG_KEY;
+
+        for (size_t s = 0; s < 2; s++) {
+            AVPacket* out = sinks[s]->pool().acquire();
+            if (!out) continue;
+            if (s == 0) {
+                int ret;
+                {
+                    AllocationCounter::Exempt exempt;
+                    ret = av_packet_ref(out, packet);
+                }
+                if (ret < 0) {
+                    sinks[s]->pool().release(out);
+                    continue;
+                }
+            } else {
+                av_packet_move_ref(out, packet);
+            }
+            sinks[s]->push(out);
+        }
+        av_packet_unref(packet);
+        allocCheck.end();
+
+        // Camera pace, so the consumers keep up and no queue hits its overflow policy
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    av_packet_free(&packet);
+    hlsQueue->stop();
+    detectQueue->stop();
+    result->steady = allocCheck.steadyIterations();
+    result->failed = allocCheck.failures();
+}
+
+// hlsWorker without the muxer
+static void mux(PacketQueue* hlsQueue) {
+    AVPacket* packet = nullptr;
+    while (hlsQueue->pop(packet)) {
+        hlsQueue->pool().release(packet);
+    }
+}
+
+// decodeWorker with a stand-in decoder that outputs one picture per packet
+static void decode(PacketQueue* detectQueue, FrameQueue* frameQueue, LoopResult* result) {
+    AVFrame* frame = av_frame_alloc();
+    AVPacket* packet = nullptr;
+    AllocationCounter::Loop allocCheck("decode");
+    while (detectQueue->pop(packet)) {
+        allocCheck.begin();
+        {
+            AllocationCounter::Exempt exempt;
+            frame->format = AV_PIX_FMT_YUV420P;
+            frame->width = 64;
+            frame->height = 48;
+            av_frame_get_buffer(frame, 0);
+        }
+        frame->pts = packet->pts;
+        frameQueue->push(frame);
+        detectQueue->pool().release(packet);
+        allocCheck.end();
+    }
+    frameQueue->stop();
+    av_frame_free(&frame);
+    result->steady = allocCheck.steadyIterations();
+    result->failed = allocCheck.failures();
+}
+
+// detectorWorker's frame hand-off
+static void inference(FrameQueue* frameQueue, LoopResult* result) {
+    AVFrame* frame = nullptr;
+    AllocationCounter::Loop allocCheck("inference");
+    while (true) {
+        allocCheck.begin();
+        if (!frameQueue->pop(frame)) break;
+        volatile uint8_t sink = frame->data[0][0];
+        (void)sink;
+        frameQueue->release(frame);
+        allocCheck.end();
+    }
+    result->steady = allocCheck.steadyIterations();
+    result->failed = allocCheck.failures();
+}
+
+static void pipelineSteadyState() {
+    MemoryBudget budget(256 * 1024 * 1024);
+    MemoryBudget::Account* account = budget.addAccount("camera", 64 * 1024 * 1024);
+    PacketPool pool;
+    PacketQueue hlsQueue("hls", budget, account, pool, OverflowPolicy::DropNonKeyframe);
+    PacketQueue detectQueue("detect", budget, account, pool, OverflowPolicy::DropNonKeyframe, 30);
+    FrameQueue frameQueue("frames", budget, account, OverflowPolicy::DropNonKeyframe, 2);
+
+    LoopResult ingestResult, decodeResult, inferenceResult;
+    std::thread muxThread(mux, &hlsQueue);
+    std::thread inferenceThread(inference, &frameQueue, &inferenceResult);
+    std::thread decodeThread(decode, &detectQueue, &frameQueue, &decodeResult);
+    std::thread ingestThread(ingest, &hlsQueue, &detectQueue, &ingestResult);
+    ingestThread.join();
+    decodeThread.join();
+    inferenceThread.join();
+    muxThread.join();
+
+    CHECK(ingestResult.steady > 0);
+    CHECK(ingestResult.failed == 0);
+    CHECK(decodeResult.steady > 0);
+    CHECK(decodeResult.failed == 0);
+    CHECK(inferenceResult.steady > 0);
+    CHECK(inferenceResult.failed == 0);
+    CHECK(hlsQueue.dropped() == 0);
+    CHECK(detectQueue.dropped() == 0);
+}
+
+int main() {
+    if (!AllocationCounter::enabled()) {
+        std::fprintf(stderr, "built without ENABLE_ALLOC_COUNTER\n");
+        return 1;
+    }
+    counterSeesAllAllocations();
+    pipelineSteadyState();
+    if (failures) {
+        std::fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("All allocation checks passed\n");
+    return 0;
+}
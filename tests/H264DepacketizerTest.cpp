@@ -0,0 +1,231 @@
+// RFC 6184 reassembly: single NAL units, STAP-A, FU-A, loss recovery, timestamps and
+// B-frame detection.
+#include "H264Depacketizer.hpp"
+#include <cstdio>
+#include <algorithm>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+typedef std::vector<uint8_t> Bytes;
+
+static const Bytes SPS = {0x67, 0x42, 0xc0, 0x1f, 0xda};
+static const Bytes PPS = {0x68, 0xce, 0x3c, 0x80};
+static const Bytes IDR = {0x65, 0x88, 0x84, 0x00, 0x33, 0xff, 0x10, 0x20, 0x30};
+static const Bytes SLICE = {0x41, 0x9a, 0x02, 0x03};
+
+static Bytes annexB(const std::vector<Bytes>& nals) {
+    Bytes out;
+    for (const Bytes& nal : nals) {
+        out.insert(out.end(), {0, 0, 0, 1});
+        out.insert(out.end(), nal.begin(), nal.end());
+    }
+    return out;
+}
+
+static Bytes stapA(const std::vector<Bytes>& nals) {
+    Bytes out = {0x78}; // F=0, NRI=3, type 24
+    for (const Bytes& nal : nals) {
+        out.push_back(static_cast<uint8_t>(nal.size() >> 8));
+        out.push_back(static_cast<uint8_t>(nal.size()));
+        out.insert(out.end(), nal.begin(), nal.end());
+    }
+    return out;
+}
+
+// Splits nal into FU-A fragments carrying at most chunk bytes of its body each
+static std::vector<Bytes> fuA(const Bytes& nal, size_t chunk) {
+    std::vector<Bytes> out;
+    uint8_t indicator = (nal[0] & 0xe0) | 28;
+    for (size_t pos = 1; pos < nal.size(); pos += chunk) {
+        size_t end = std::min(nal.size(), pos + chunk);
+        uint8_t header = nal[0] & 0x1f;
+        if (pos == 1) header |= 0x80;
+        if (end == nal.size()) header |= 0x40;
+        Bytes fragment = {indicator, header};
+        fragment.insert(fragment.end(), nal.begin() + pos, nal.begin() + end);
+        out.push_back(fragment);
+    }
+    return out;
+}
+
+struct Sender {
+    H264Depacketizer& d;
+    uint16_t seq = 1000;
+    void send(const Bytes& payload, uint32_t timestamp, bool marker) {
+        d.push(payload.data(), payload.size(), seq++, timestamp, marker);
+    }
+};
+
+static void singleNalUnits() {
+    H264Depacketizer d;
+    Sender s{d};
+    // Not a keyframe yet: dropped
+    s.send(SLICE, 0, true);
+    s.send(SPS, 3000, false);
+    s.send(PPS, 3000, false);
+    s.send(IDR, 3000, true);
+    s.send(SLICE, 6000, true);
+
+    H264Depacketizer::AccessUnit unit;
+    CHECK(d.pop(unit));
+    CHECK(unit.keyframe);
+    CHECK(unit.pts == 0);
+    CHECK(unit.data == annexB({SPS, PPS, IDR}));
+    CHECK(d.pop(unit));
+    CHECK(!unit.keyframe);
+    CHECK(unit.pts == 3000);
+    CHECK(unit.data == annexB({SLICE}));
+    CHECK(!d.pop(unit));
+    CHECK(d.sps() == std::string(SPS.begin(), SPS.end()));
+    CHECK(d.pps() == std::string(PPS.begin(), PPS.end()));
+}
+
+static void stapAggregates() {
+    H264Depacketizer d;
+    Sender s{d};
+    s.send(stapA({SPS, PPS, IDR}), 90000, true);
+    // A truncated aggregate keeps the units that fit
+    Bytes truncated = stapA({SLICE, SLICE});
+    truncated.resize(truncated.size() - 1);
+    s.send(truncated, 93000, true);
+
+    H264Depacketizer::AccessUnit unit;
+    CHECK(d.pop(unit));
+    CHECK(unit.keyframe);
+    CHECK(unit.data == annexB({SPS, PPS, IDR}));
+    CHECK(d.pop(unit));
+    CHECK(unit.pts == 3000);
+    CHECK(unit.data == annexB({SLICE}));
+    CHECK(!d.pop(unit));
+}
+
+static void fuAFragments() {
+    H264Depacketizer d;
+    Sender s{d};
+    s.send(SPS, 0, false);
+    s.send(PPS, 0, false);
+    std::vector<Bytes> fragments = fuA(IDR, 3);
+    CHECK(fragments.size() == 3);
+    for (size_t i = 0; i < fragments.size(); i++) s.send(fragments[i], 0, i + 1 == fragments.size());
+
+    H264Depacketizer::AccessUnit unit;
+    CHECK(d.pop(unit));
+    CHECK(unit.keyframe);
+    CHECK(unit.data == annexB({SPS, PPS, IDR}));
+    CHECK(!d.pop(unit));
+}
+
+static void lossWaitsForKeyframe() {
+    H264Depacketizer d;
+    Sender s{d};
+    s.send(stapA({SPS, PPS}), 0, false);
+    s.send(IDR, 0, true);
+
+    // Middle fragment lost: the frame and everything up to the next keyframe is dropped
+    std::vector<Bytes> fragments = fuA(SLICE, 1);
+    s.send(fragments[0], 3000, false);
+    s.seq++;
+    s.send(fragments[2], 3000, true);
+    s.send(SLICE, 6000, true);
+    // The next keyframe has no in-band parameter sets: the known ones are prepended
+    s.send(IDR, 9000, true);
+
+    H264Depacketizer::AccessUnit unit;
+    CHECK(d.pop(unit));
+    CHECK(unit.pts == 0);
+    CHECK(d.pop(unit));
+    CHECK(unit.keyframe);
+    CHECK(unit.pts == 9000);
+    CHECK(unit.data == annexB({SPS, PPS, IDR}));
+    CHECK(!d.pop(unit));
+
+    // A continuation fragment without its start is dropped as well
+    s.send(fragments[1], 12000, false);
+    s.send(fragments[2], 12000, true);
+    CHECK(!d.pop(unit));
+}
+
+static void sdpParameterSets() {
+    H264Depacketizer d;
+    d.addParameterSet(SPS.data(), SPS.size());
+    d.addParameterSet(PPS.data(), PPS.size());
+    Sender s{d};
+    s.send(IDR, 0, true);
+
+    H264Depacketizer::AccessUnit unit;
+    CHECK(d.pop(unit));
+    CHECK(unit.data == annexB({SPS, PPS, IDR}));
+
+    // Kept across reset(), which drops buffered data and the stream position
+    s.send(SLICE, 3000, true);
+    d.reset();
+    CHECK(!d.pop(unit));
+    s.send(IDR, 500, true);
+    CHECK(d.pop(unit));
+    CHECK(unit.pts == 0);
+    CHECK(unit.data == annexB({SPS, PPS, IDR}));
+}
+
+static void timestampsUnwrap() {
+    H264Depacketizer d;
+    Sender s{d};
+    // No marker bits: a new timestamp completes the previous access unit
+    s.send(stapA({SPS, PPS, IDR}), 0xfffff000u, false);
+    s.send(SLICE, 0x00000800u, false);
+    s.send(SLICE, 0x00001800u, true);
+
+    H264Depacketizer::AccessUnit unit;
+    CHECK(d.pop(unit));
+    CHECK(unit.pts == 0);
+    CHECK(d.pop(unit));
+    CHECK(unit.pts == 0x1800);
+    CHECK(d.pop(unit));
+    CHECK(unit.pts == 0x2800);
+    CHECK(!d.pop(unit));
+}
+
+static void bFramesAreFlagged() {
+    H264Depacketizer d;
+    Sender s{d};
+    // Decode order I0 P3 B1: the B-frame's timestamp steps back
+    s.send(stapA({SPS, PPS, IDR}), 0, true);
+    s.send(SLICE, 9000, true);
+    s.send(SLICE, 3000, true);
+    s.send(SLICE, 6000, true);
+    CHECK(d.reordered());
+
+    H264Depacketizer::AccessUnit unit;
+    CHECK(d.pop(unit));
+    CHECK(unit.pts == 0);
+    CHECK(d.pop(unit));
+    CHECK(unit.pts == 9000);
+    CHECK(!d.pop(unit));
+
+    d.reset();
+    CHECK(!d.reordered());
+}
+
+int main() {
+    singleNalUnits();
+    stapAggregates();
+    fuAFragments();
+    lossWaitsForKeyframe();
+    sdpParameterSets();
+    timestampsUnwrap();
+    bFramesAreFlagged();
+    if (failures) {
+        std::fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("All H264Depacketizer checks passed\n");
+    return 0;
+}
@@ -1,11 +1,13 @@
 from fastapi import FastAPI, Request
-from fastapi.responses import HTMLResponse, JSONResponse
+from fastapi.responses import HTMLResponse, JSONResponse, StreamingResponse
 from fastapi.staticfiles import StaticFiles
 from fastapi.templating import Jinja2Templates
 import uvicorn
 import asyncpg
 import os
 import asyncio
+import json
+from collections import deque
 from typing import List, Optional
 from pydantic import BaseModel
 
@@ -15,36 +17,149 @@ app = FastAPI()
 BASE_DIR = os.path.dirname(os.path.abspath(__file__))
 FRAMES_DIR = os.path.join(BASE_DIR, "../detected_frames")
 HLS_DIR = os.path.join(BASE_DIR, "../hls_output")
+CLIPS_DIR = os.path.join(BASE_DIR, "../clips")
 TEMPLATE_DIR = os.path.join(BASE_DIR, "templates")
 
 # Mount static files (images and HLS)
 app.mount("/images", StaticFiles(directory=FRAMES_DIR), name="images")
 app.mount("/hls", StaticFiles(directory=HLS_DIR), name="hls")
+os.makedirs(CLIPS_DIR, exist_ok=True)
+app.mount("/clips", StaticFiles(directory=CLIPS_DIR), name="clips")
 
 templates = Jinja2Templates(directory=TEMPLATE_DIR)
 
 # Database Connection Pool
 pool = None
 
+# Push feed: the pipeline publishes every detection on this NOTIFY channel. One listener
+# connection fills an in-memory ring and fans events out to SSE clients, so the number of
+# open dashboards never turns into database queries.
+NOTIFY_CHANNEL = "detections"
+RECENT_LIMIT = 20
+recent = deque(maxlen=RECENT_LIMIT)
+subscribers = set()
+listener = None
+
+def env_int(key, default):
+    value = os.getenv(key)
+    try:
+        return int(value) if value is not None else default
+    except ValueError:
+        print(f"[CONFIG] Ignoring invalid {key}='{value}', using {default}")
+        return default
+
+# Same database as the pool; the listener uses its own connection so it can be
+# re-established on its own when the server restarts or the connection drops.
+# Read from the same env vars as the pipeline.
+DB_ARGS = dict(
+    user=os.getenv("POSTGRES_USER", "admin"),
+    password=os.getenv("POSTGRES_PASSWORD", "password"),
+    database=os.getenv("POSTGRES_DB", "analytics_db"),
+    host=os.getenv("DB_HOST", "localhost"),
+    port=env_int("DB_PORT", 5432)
+)
+LISTEN_RETRY_MAX_SEC = 30
+listen_task = None
+
+def on_detection(connection, pid, channel, payload):
+    try:
+        det = json.loads(payload)
+    except ValueError:
+        return
+    recent.appendleft(det)
+    for queue in list(subscribers):
+        try:
+            queue.put_nowait(det)
+        except asyncio.QueueFull:
+            # Slow client: end its stream; EventSource reconnects and resyncs from /detections
+            end_stream(queue)
+
+def end_stream(queue):
+    subscribers.discard(queue)
+    if queue.full():
+        queue.get_nowait()
+    queue.put_nowait(None)
+
+def on_listener_lost(connection):
+    global listener
+    if connection is not listener:
+        return
+    listener = None
+    print("Detection listener connection lost, reconnecting")
+    start_listening()
+
+def start_listening():
+    global listen_task
+    if listen_task is None or listen_task.done():
+        listen_task = asyncio.get_running_loop().create_task(listen())
+
+async def seed_recent():
+    # Merged by id with whatever notifications arrived while the query ran
+    try:
+        async with pool.acquire() as connection:
+            rows = await connection.fetch("""
+                SELECT id, device_name, class_name, confidence, timestamp, frame_path, stream_time, clip_path
+                FROM detections
+                ORDER BY id DESC
+                LIMIT $1
+            """, RECENT_LIMIT)
+    except asyncpg.UndefinedTableError:
+        return  # The pipeline creates the table on its first run
+    merged = {det["id"]: det for det in (dict(row) for row in rows)}
+    for det in recent:
+        merged.setdefault(det.get("id"), det)
+    newest = sorted(merged.values(), key=lambda det: det.get("id") or 0, reverse=True)
+    recent.clear()
+    recent.extend(newest[:RECENT_LIMIT])
+
+async def listen():
+    # LISTEN first, then seed, so nothing published in between is missed. Retries with
+    # backoff until the database is reachable again; the pool is created in the same loop
+    # if it could not be created yet.
+    global listener, pool
+    delay = 1
+    while True:
+        connection = None
+        try:
+            if pool is None:
+                pool = await asyncpg.create_pool(**DB_ARGS)
+                print("Connected to PostgreSQL")
+            connection = await asyncpg.connect(**DB_ARGS)
+            await connection.add_listener(NOTIFY_CHANNEL, on_detection)
+            connection.add_termination_listener(on_listener_lost)
+            listener = connection
+            await seed_recent()
+            if connection.is_closed():
+                raise ConnectionError("listener connection closed while seeding")
+            break
+        except Exception as e:
+            print(f"Detection listener failed: {e}; retrying in {delay}s")
+            if connection is not None:
+                listener = None
+                connection.terminate()
+            await asyncio.sleep(delay)
+            delay = min(delay * 2, LISTEN_RETRY_MAX_SEC)
+
+    # Dashboards may have missed events while the listener was down: end their streams so
+    # they reconnect and resync from /detections
+    for queue in list(subscribers):
+        end_stream(queue)
+
 @app.on_event("startup")
 async def startup():
-    global pool
-    # Connect to PostgreSQL
-    # Using defaults for localhost/dev. 
-    # Production would use env vars: os.getenv("DB_HOST", "localhost")
-    try:
-        pool = await asyncpg.create_pool(
-            user="admin", 
-            password="password", 
-            database="analytics_db", 
-            host="localhost"
-        )
-        print("Connected to PostgreSQL")
-    except Exception as e:
-        print(f"Failed to connect to DB: {e}")
+    # Connects in the background so the API comes up even while PostgreSQL is still
+    # starting. The ring is seeded once the listener is up; after that it is kept current
+    # by notifications
+    start_listening()
 
 @app.on_event("shutdown")
 async def shutdown():
+    global listener
+    if listen_task:
+        listen_task.cancel()
+    if listener:
+        connection, listener = listener, None
+        await connection.close()
     if pool:
         await pool.close()
 
@@ -54,17 +169,30 @@ async def read_root(request: Request):
 
 @app.get("/detections")
 async def get_detections():
-    if not pool:
-        return []
-    async with pool.acquire() as connection:
-        # Fetch last 20 detections
-        rows = await connection.fetch("""
-            SELECT device_name, class_name, confidence, timestamp, frame_path 
-            FROM detections 
-            ORDER BY id DESC 
-            LIMIT 20
-        """)
-        return [dict(row) for row in rows]
+    # Last 20 detections, served from memory
+    return list(recent)
+
+@app.get("/detections/stream")
+async def stream_detections(request: Request):
+    # Server-sent events: one "data:" line of JSON per detection
+    queue = asyncio.Queue(maxsize=100)
+    subscribers.add(queue)
+
+    async def events():
+        try:
+            while not await request.is_disconnected():
+                try:
+                    det = await asyncio.wait_for(queue.get(), timeout=15)
+                    if det is None:
+                        break
+                    yield f"data: {json.dumps(det)}\n\n"
+                except asyncio.TimeoutError:
+                    yield ": keep-alive\n\n"
+        finally:
+            subscribers.discard(queue)
+
+    return StreamingResponse(events(), media_type="text/event-stream",
+                             headers={"Cache-Control": "no-cache"})
 
 if __name__ == "__main__":
     uvicorn.run(app, host="0.0.0.0", port=9090)